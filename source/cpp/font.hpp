@@ -0,0 +1,23 @@
+#ifndef FONT_HPP
+#define FONT_HPP
+
+#include "../font.h"
+#include "../ttf.h"
+
+struct cppfont_t : font_t
+{
+    bool open(uint64_t file, uint64_t size)
+    {
+        return font_open(this, file, size);
+    }
+    bool open_ttf(uint64_t file, uint64_t size, uint8_t height)
+    {
+        return ttf_open_font(this, file, size, height);
+    }
+    void close()
+    {
+        font_close(this);
+    }
+};
+
+#endif // FONT_HPP
@@ -3,6 +3,7 @@
 
 #include "../term.h"
 #include "image.hpp"
+#include "font.hpp"
 
 struct cppterm_t : term_t
 {
@@ -26,6 +27,11 @@ struct cppterm_t : term_t
         term_vbe(this, frm, font, style, back);
     }
 
+    void vbe_attach(framebuffer_t frm, term_t *source)
+    {
+        term_vbe_attach(this, frm, source);
+    }
+
 #if defined(__i386__) || defined(__x86_64__)
     void textmode()
     {
@@ -38,6 +44,86 @@ struct cppterm_t : term_t
         term_notready(this);
     }
 
+    void custom_backend(const term_backend_ops *ops, void *backend, size_t cols, size_t rows)
+    {
+        term_custom_backend(this, ops, backend, cols, rows);
+    }
+
+    void set_clock(clock_callback_t clock)
+    {
+        term_set_clock(this, clock);
+    }
+
+    void set_sync_timeout(uint64_t timeout)
+    {
+        term_set_sync_timeout(this, timeout);
+    }
+
+    void set_parallel_hooks(parallel_submit_t submit, parallel_wait_t wait, size_t nworkers)
+    {
+        term_set_parallel_hooks(this, submit, wait, nworkers);
+    }
+
+    void set_frame_interval(uint64_t interval)
+    {
+        term_set_frame_interval(this, interval);
+    }
+
+    void present()
+    {
+        term_present(this);
+    }
+
+    bool tick()
+    {
+        return term_tick(this);
+    }
+
+    bool cursor_tick()
+    {
+        return term_cursor_tick(this);
+    }
+
+    bool set_split_render(bool enable)
+    {
+        return term_set_split_render(this, enable);
+    }
+
+    bool render()
+    {
+        return term_render(this);
+    }
+
+    void set_visible(bool visible)
+    {
+        term_set_visible(this, visible);
+    }
+
+    void set_palette(size_t index, uint32_t rgb)
+    {
+        term_set_palette(this, index, rgb);
+    }
+
+    void reset_palette()
+    {
+        term_reset_palette(this);
+    }
+
+    bool set_scrollback(size_t lines)
+    {
+        return term_set_scrollback(this, lines);
+    }
+
+    void scroll_viewport(int64_t lines)
+    {
+        term_scroll_viewport(this, lines);
+    }
+
+    void viewport_reset()
+    {
+        term_viewport_reset(this);
+    }
+
     void putchar(uint8_t c)
     {
         term_putchar(this, c);
@@ -48,11 +134,56 @@ struct cppterm_t : term_t
         term_write(this, buf, count);
     }
 
+    void set_ring(void *buffer, size_t size)
+    {
+        term_set_ring(this, buffer, size);
+    }
+
+    bool ring_write(const char *buf, size_t count)
+    {
+        return term_ring_write(this, buf, count);
+    }
+
+    void ring_drain()
+    {
+        term_ring_drain(this);
+    }
+
+    bool read_snapshot(term_snapshot *snap)
+    {
+        return term_read_snapshot(this, snap);
+    }
+
+    void panic()
+    {
+        term_panic(this);
+    }
+
+    void panic_write(const char *buf, size_t count)
+    {
+        term_panic_write(this, buf, count);
+    }
+
+    size_t read_responses(char *buf, size_t count)
+    {
+        return term_read_responses(this, buf, count);
+    }
+
     void raw_putchar(uint8_t c)
     {
         term_raw_putchar(this, c);
     }
 
+    void repeat_char(uint8_t c, size_t count)
+    {
+        term_repeat_char(this, c, count);
+    }
+
+    bool put_code_point(uint32_t code_point)
+    {
+        return term_put_code_point(this, code_point);
+    }
+
     void clear(bool move)
     {
         term_clear(this, move);
@@ -67,6 +198,11 @@ struct cppterm_t : term_t
         return term_disable_cursor(this);
     }
 
+    void set_cursor_shape(size_t shape, bool blink)
+    {
+        term_set_cursor_shape(this, shape, blink);
+    }
+
     void set_cursor_pos(size_t x, size_t y)
     {
         term_set_cursor_pos(this, x, y);
@@ -107,6 +243,21 @@ struct cppterm_t : term_t
         term_set_text_bg_rgb(this, bg);
     }
 
+    void set_text_fg_indexed(size_t fg)
+    {
+        term_set_text_fg_indexed(this, fg);
+    }
+
+    void set_text_bg_indexed(size_t bg)
+    {
+        term_set_text_bg_indexed(this, bg);
+    }
+
+    void set_text_attributes(uint32_t attributes)
+    {
+        term_set_text_attributes(this, attributes);
+    }
+
     void set_text_fg_default()
     {
         term_set_text_fg_default(this);
@@ -132,6 +283,26 @@ struct cppterm_t : term_t
         term_move_character(this, new_x, new_y, old_x, old_y);
     }
 
+    void insert_chars(size_t x, size_t y, size_t count)
+    {
+        term_insert_chars(this, x, y, count);
+    }
+
+    void delete_chars(size_t x, size_t y, size_t count)
+    {
+        term_delete_chars(this, x, y, count);
+    }
+
+    void insert_lines(size_t y, size_t count)
+    {
+        term_insert_lines(this, y, count);
+    }
+
+    void delete_lines(size_t y, size_t count)
+    {
+        term_delete_lines(this, y, count);
+    }
+
     void scroll()
     {
         term_scroll(this);
@@ -162,6 +333,11 @@ struct cppterm_t : term_t
         term_double_buffer_flush(this);
     }
 
+    bool flush_budget(size_t max_cells, uint64_t max_time = 0)
+    {
+        return term_flush_budget(this, max_cells, max_time);
+    }
+
     uint64_t context_size()
     {
         return term_context_size(this);
@@ -0,0 +1,268 @@
+#include "font.h"
+#include "term.h"
+
+static bool map_less(const struct font_map_t *a, const struct font_map_t *b)
+{
+    return a->code_point < b->code_point || (a->code_point == b->code_point && a->glyph < b->glyph);
+}
+
+static void map_sift_down(struct font_map_t *map, size_t i, size_t count)
+{
+    while (i * 2 + 1 < count)
+    {
+        size_t child = i * 2 + 1;
+        if (child + 1 < count && map_less(&map[child], &map[child + 1]))
+            child++;
+        if (!map_less(&map[i], &map[child]))
+            return;
+
+        struct font_map_t tmp = map[i];
+        map[i] = map[child];
+        map[child] = tmp;
+        i = child;
+    }
+}
+
+// Sorts the map by code point and drops duplicate code points, keeping the lowest glyph
+static size_t map_sort(struct font_map_t *map, size_t count)
+{
+    for (size_t i = count / 2; i-- > 0; )
+        map_sift_down(map, i, count);
+
+    for (size_t end = count; end > 1; end--)
+    {
+        struct font_map_t tmp = map[0];
+        map[0] = map[end - 1];
+        map[end - 1] = tmp;
+        map_sift_down(map, 0, end - 1);
+    }
+
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++)
+        if (unique == 0 || map[unique - 1].code_point != map[i].code_point)
+            map[unique++] = map[i];
+
+    return unique;
+}
+
+// The PSF1 table has a list of UCS-2 code points per glyph ending with 0xFFFF, sequences of
+// combining characters start with 0xFFFE and are skipped. Counts the entries if map is NULL.
+static size_t psf1_table(const uint8_t *table, size_t size, uint32_t glyphs, struct font_map_t *map)
+{
+    size_t count = 0;
+    uint32_t glyph = 0;
+    bool sequence = false;
+
+    for (size_t i = 0; i + 1 < size && glyph < glyphs; i += 2)
+    {
+        uint16_t entry = table[i] | (table[i + 1] << 8);
+        if (entry == 0xFFFF)
+        {
+            glyph++;
+            sequence = false;
+        }
+        else if (entry == 0xFFFE)
+            sequence = true;
+        else if (!sequence)
+        {
+            if (map != NULL)
+            {
+                map[count].code_point = entry;
+                map[count].glyph = glyph;
+            }
+            count++;
+        }
+    }
+
+    return count;
+}
+
+// The PSF2 table is the same with UTF-8 code points ending with 0xFF, sequences start with 0xFE
+static size_t psf2_table(const uint8_t *table, size_t size, uint32_t glyphs, struct font_map_t *map)
+{
+    size_t count = 0;
+    uint32_t glyph = 0;
+    bool sequence = false;
+
+    for (size_t i = 0; i < size && glyph < glyphs; )
+    {
+        uint8_t c = table[i];
+        if (c == 0xFF)
+        {
+            glyph++;
+            sequence = false;
+            i++;
+            continue;
+        }
+        if (c == 0xFE)
+        {
+            sequence = true;
+            i++;
+            continue;
+        }
+
+        size_t length = c < 0x80 ? 1 : (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 0;
+        uint32_t code_point = length == 1 ? c : length == 2 ? (c & 0x1F) : length == 3 ? (c & 0x0F) : (c & 0x07);
+
+        bool valid = length != 0 && i + length <= size;
+        for (size_t j = 1; valid && j < length; j++)
+        {
+            if ((table[i + j] & 0xC0) != 0x80)
+                valid = false;
+            code_point = (code_point << 6) | (table[i + j] & 0x3F);
+        }
+
+        if (!valid)
+        {
+            i++;
+            continue;
+        }
+        i += length;
+
+        if (!sequence)
+        {
+            if (map != NULL)
+            {
+                map[count].code_point = code_point;
+                map[count].glyph = glyph;
+            }
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static bool open_table(struct font_t *font, const uint8_t *table, size_t size, bool psf2)
+{
+    size_t count = psf2 ? psf2_table(table, size, font->glyphs, NULL) : psf1_table(table, size, font->glyphs, NULL);
+    if (count == 0)
+        return true;
+
+    struct font_map_t *map = alloc_mem(count * sizeof(struct font_map_t));
+    if (map == NULL)
+        return false;
+
+    if (psf2)
+        psf2_table(table, size, font->glyphs, map);
+    else
+        psf1_table(table, size, font->glyphs, map);
+
+    font->map_size = map_sort(map, count);
+    font->map = map;
+    font->allocated_map_size = count * sizeof(struct font_map_t);
+    return true;
+}
+
+bool psf1_open_font(struct font_t *font, uint64_t file, uint64_t size)
+{
+    struct psf1_header header;
+    if (size < sizeof(struct psf1_header))
+        return false;
+
+    memcpy(&header, (uint8_t*)file, sizeof(struct psf1_header));
+    if (header.magic != PSF1_MAGIC || header.charsize == 0)
+        return false;
+
+    uint32_t glyphs = (header.mode & PSF1_MODE512) ? 512 : 256;
+    size_t glyph_bytes = (size_t)glyphs * header.charsize;
+    if (sizeof(struct psf1_header) + glyph_bytes > size)
+        return false;
+
+    memset(font, 0, sizeof(struct font_t));
+    font->address = file + sizeof(struct psf1_header);
+    font->width = 8;
+    font->height = header.charsize;
+    font->glyphs = glyphs;
+
+    if (header.mode & (PSF1_MODEHASTAB | PSF1_MODESEQ))
+    {
+        size_t table = sizeof(struct psf1_header) + glyph_bytes;
+        if (!open_table(font, (uint8_t*)(file + table), size - table, false))
+            return false;
+    }
+
+    return true;
+}
+
+bool psf2_open_font(struct font_t *font, uint64_t file, uint64_t size)
+{
+    struct psf2_header header;
+    if (size < sizeof(struct psf2_header))
+        return false;
+
+    memcpy(&header, (uint8_t*)file, sizeof(struct psf2_header));
+    if (header.magic != PSF2_MAGIC || header.length == 0 || header.headersize < sizeof(struct psf2_header))
+        return false;
+
+    if (header.width == 0 || header.width > 0xFF || header.height == 0 || header.height > 0xFF)
+        return false;
+
+    size_t row_bytes = (header.width + 7) / 8;
+    size_t packed = row_bytes * header.height;
+    if (header.charsize < packed || header.headersize > size || (size - header.headersize) / header.charsize < header.length)
+        return false;
+
+    memset(font, 0, sizeof(struct font_t));
+    font->width = header.width;
+    font->height = header.height;
+    font->glyphs = header.length;
+
+    // Glyphs are used straight from the file when they are laid out the way terminals read
+    // them, padded glyphs are packed into a copy
+    uint8_t *glyphs = (uint8_t*)(file + header.headersize);
+    if (header.charsize == packed)
+        font->address = (uintptr_t)glyphs;
+    else
+    {
+        uint8_t *bits = alloc_mem(packed * header.length);
+        if (bits == NULL)
+            return false;
+
+        for (size_t i = 0; i < header.length; i++)
+            memcpy(&bits[i * packed], &glyphs[i * header.charsize], packed);
+
+        font->address = (uintptr_t)bits;
+        font->allocated_size = packed * header.length;
+    }
+
+    if (header.flags & PSF2_HAS_UNICODE_TABLE)
+    {
+        size_t table = header.headersize + (size_t)header.length * header.charsize;
+        if (!open_table(font, (uint8_t*)(file + table), size - table, true))
+        {
+            font_close(font);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Spacing and scaling are left at 0, set them after opening the font
+bool font_open(struct font_t *font, uint64_t file, uint64_t size)
+{
+    if (psf2_open_font(font, file, size))
+        return true;
+    if (psf1_open_font(font, file, size))
+        return true;
+    return false;
+}
+
+void font_close(struct font_t *font)
+{
+    if (font->allocated_size != 0)
+        free_mem((void*)font->address, font->allocated_size);
+    if (font->allocated_map_size != 0)
+        free_mem((void*)font->map, font->allocated_map_size);
+    if (font->allocated_renderer_size != 0)
+        free_mem(font->renderer, font->allocated_renderer_size);
+
+    font->allocated_size = 0;
+    font->allocated_map_size = 0;
+    font->allocated_renderer_size = 0;
+    font->map = NULL;
+    font->map_size = 0;
+    font->render = NULL;
+    font->renderer = NULL;
+}
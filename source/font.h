@@ -0,0 +1,88 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FONT_GLYPHS 256
+
+#define PSF1_MAGIC 0x0436
+#define PSF1_MODE512 0x01
+#define PSF1_MODEHASTAB 0x02
+#define PSF1_MODESEQ 0x04
+
+#define PSF2_MAGIC 0x864AB572
+#define PSF2_HAS_UNICODE_TABLE 0x01
+
+struct psf1_header
+{
+    uint16_t magic;
+    uint8_t mode;
+    uint8_t charsize;
+} __attribute__((packed));
+
+struct psf2_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headersize;
+    uint32_t flags;
+    uint32_t length;
+    uint32_t charsize;
+    uint32_t height;
+    uint32_t width;
+} __attribute__((packed));
+
+// Maps a code point to a glyph of the font, sorted by code point
+struct font_map_t
+{
+    uint32_t code_point;
+    uint32_t glyph;
+};
+
+// Glyph rows are (width * bpp + 7) / 8 bytes, most significant bits first. bpp is 1 (or 0)
+// for bitmap fonts, 2, 4 or 8 for anti-aliased fonts storing the coverage of each pixel, from
+// 0 (background) to the largest value (foreground). A font with more than
+// FONT_GLYPHS glyphs sets glyphs, and a map to let text use glyphs outside of code page 437
+// (the first 256 glyphs are still taken to be code page 437 if there is no map).
+// Terminals use the glyphs and the map in place, they have to stay mapped while in use.
+struct font_t
+{
+    uintptr_t address;
+    uint8_t width;
+    uint8_t height;
+    uint8_t spacing;
+    uint8_t scale_x;
+    uint8_t scale_y;
+    uint32_t glyphs;
+    const struct font_map_t *map;
+    size_t map_size;
+    uint8_t bpp;
+
+    // Outline fonts leave address at 0 and set render, called the first time a glyph is used
+    // to fill width by height coverage bytes (bpp 8) with rows stride bytes apart
+    bool (*render)(void *renderer, uint32_t glyph, uint8_t *coverage, size_t stride);
+    void *renderer;
+
+    // Set by font_open() for the map and for glyphs it had to repack rather than use in place,
+    // and by ttf_open_font() for the map and the renderer
+    size_t allocated_size;
+    size_t allocated_map_size;
+    size_t allocated_renderer_size;
+};
+
+bool psf1_open_font(struct font_t *font, uint64_t file, uint64_t size);
+bool psf2_open_font(struct font_t *font, uint64_t file, uint64_t size);
+bool font_open(struct font_t *font, uint64_t file, uint64_t size);
+void font_close(struct font_t *font);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FONT_H
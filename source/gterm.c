@@ -47,6 +47,50 @@ void gterm_swap_palette(struct gterm_t *gterm)
     gterm->context.text_fg = tmp;
 }
 
+// Default colours of palette entries 16 to 255
+static const uint32_t col256[] = {
+    0x000000, 0x00005f, 0x000087, 0x0000af, 0x0000d7, 0x0000ff, 0x005f00, 0x005f5f,
+    0x005f87, 0x005faf, 0x005fd7, 0x005fff, 0x008700, 0x00875f, 0x008787, 0x0087af,
+    0x0087d7, 0x0087ff, 0x00af00, 0x00af5f, 0x00af87, 0x00afaf, 0x00afd7, 0x00afff,
+    0x00d700, 0x00d75f, 0x00d787, 0x00d7af, 0x00d7d7, 0x00d7ff, 0x00ff00, 0x00ff5f,
+    0x00ff87, 0x00ffaf, 0x00ffd7, 0x00ffff, 0x5f0000, 0x5f005f, 0x5f0087, 0x5f00af,
+    0x5f00d7, 0x5f00ff, 0x5f5f00, 0x5f5f5f, 0x5f5f87, 0x5f5faf, 0x5f5fd7, 0x5f5fff,
+    0x5f8700, 0x5f875f, 0x5f8787, 0x5f87af, 0x5f87d7, 0x5f87ff, 0x5faf00, 0x5faf5f,
+    0x5faf87, 0x5fafaf, 0x5fafd7, 0x5fafff, 0x5fd700, 0x5fd75f, 0x5fd787, 0x5fd7af,
+    0x5fd7d7, 0x5fd7ff, 0x5fff00, 0x5fff5f, 0x5fff87, 0x5fffaf, 0x5fffd7, 0x5fffff,
+    0x870000, 0x87005f, 0x870087, 0x8700af, 0x8700d7, 0x8700ff, 0x875f00, 0x875f5f,
+    0x875f87, 0x875faf, 0x875fd7, 0x875fff, 0x878700, 0x87875f, 0x878787, 0x8787af,
+    0x8787d7, 0x8787ff, 0x87af00, 0x87af5f, 0x87af87, 0x87afaf, 0x87afd7, 0x87afff,
+    0x87d700, 0x87d75f, 0x87d787, 0x87d7af, 0x87d7d7, 0x87d7ff, 0x87ff00, 0x87ff5f,
+    0x87ff87, 0x87ffaf, 0x87ffd7, 0x87ffff, 0xaf0000, 0xaf005f, 0xaf0087, 0xaf00af,
+    0xaf00d7, 0xaf00ff, 0xaf5f00, 0xaf5f5f, 0xaf5f87, 0xaf5faf, 0xaf5fd7, 0xaf5fff,
+    0xaf8700, 0xaf875f, 0xaf8787, 0xaf87af, 0xaf87d7, 0xaf87ff, 0xafaf00, 0xafaf5f,
+    0xafaf87, 0xafafaf, 0xafafd7, 0xafafff, 0xafd700, 0xafd75f, 0xafd787, 0xafd7af,
+    0xafd7d7, 0xafd7ff, 0xafff00, 0xafff5f, 0xafff87, 0xafffaf, 0xafffd7, 0xafffff,
+    0xd70000, 0xd7005f, 0xd70087, 0xd700af, 0xd700d7, 0xd700ff, 0xd75f00, 0xd75f5f,
+    0xd75f87, 0xd75faf, 0xd75fd7, 0xd75fff, 0xd78700, 0xd7875f, 0xd78787, 0xd787af,
+    0xd787d7, 0xd787ff, 0xd7af00, 0xd7af5f, 0xd7af87, 0xd7afaf, 0xd7afd7, 0xd7afff,
+    0xd7d700, 0xd7d75f, 0xd7d787, 0xd7d7af, 0xd7d7d7, 0xd7d7ff, 0xd7ff00, 0xd7ff5f,
+    0xd7ff87, 0xd7ffaf, 0xd7ffd7, 0xd7ffff, 0xff0000, 0xff005f, 0xff0087, 0xff00af,
+    0xff00d7, 0xff00ff, 0xff5f00, 0xff5f5f, 0xff5f87, 0xff5faf, 0xff5fd7, 0xff5fff,
+    0xff8700, 0xff875f, 0xff8787, 0xff87af, 0xff87d7, 0xff87ff, 0xffaf00, 0xffaf5f,
+    0xffaf87, 0xffafaf, 0xffafd7, 0xffafff, 0xffd700, 0xffd75f, 0xffd787, 0xffd7af,
+    0xffd7d7, 0xffd7ff, 0xffff00, 0xffff5f, 0xffff87, 0xffffaf, 0xffffd7, 0xffffff,
+    0x080808, 0x121212, 0x1c1c1c, 0x262626, 0x303030, 0x3a3a3a, 0x444444, 0x4e4e4e,
+    0x585858, 0x626262, 0x6c6c6c, 0x767676, 0x808080, 0x8a8a8a, 0x949494, 0x9e9e9e,
+    0xa8a8a8, 0xb2b2b2, 0xbcbcbc, 0xc6c6c6, 0xd0d0d0, 0xdadada, 0xe4e4e4, 0xeeeeee
+};
+
+// Cells keep indexed colours as palette references, resolved only when drawn, so that a
+// palette change can re-tint them. Direct colours are kept to 24 bits to tell them apart.
+#define PALETTE_REF 0x01000000
+#define IS_PALETTE_REF(colour) (((colour) & 0xFF000000) == PALETTE_REF)
+
+static inline uint32_t resolve_colour(struct gterm_t *gterm, uint32_t colour)
+{
+    return IS_PALETTE_REF(colour) ? gterm->palette[colour & 0xFF] : colour;
+}
+
 #define A(rgb) (uint8_t)(rgb >> 24)
 #define R(rgb) (uint8_t)(rgb >> 16)
 #define G(rgb) (uint8_t)(rgb >> 8)
@@ -215,8 +259,22 @@ static void loop_internal(struct gterm_t *gterm, size_t xstart, size_t xend, siz
     genloop(gterm, xstart, xend, ystart, yend, blend_internal);
 }
 
-static void generate_canvas(struct gterm_t *gterm)
+static void clip_loop(void (*loop)(struct gterm_t*, size_t, size_t, size_t, size_t), struct gterm_t *gterm, size_t xstart, size_t xend, size_t ystart, size_t yend, size_t band_start, size_t band_end)
+{
+    if (ystart < band_start)
+        ystart = band_start;
+    if (yend > band_end)
+        yend = band_end;
+
+    if (ystart < yend)
+        loop(gterm, xstart, xend, ystart, yend);
+}
+
+// Generates the pixel rows [band_start, band_end) of the canvas
+static void generate_canvas_band(void *ctx, size_t band_start, size_t band_end)
 {
+    struct gterm_t *gterm = ctx;
+
     if (gterm->background != NULL)
     {
         int64_t margin_no_gradient = (int64_t)gterm->margin - gterm->margin_gradient;
@@ -227,27 +285,27 @@ static void generate_canvas(struct gterm_t *gterm)
         size_t scan_stop_x = gterm->framebuffer.width - margin_no_gradient;
         size_t scan_stop_y = gterm->framebuffer.height - margin_no_gradient;
 
-        loop_external(gterm, 0, gterm->framebuffer.width, 0, margin_no_gradient);
-        loop_external(gterm, 0, gterm->framebuffer.width, scan_stop_y, gterm->framebuffer.height);
-        loop_external(gterm, 0, margin_no_gradient, margin_no_gradient, scan_stop_y);
-        loop_external(gterm, scan_stop_x, gterm->framebuffer.width, margin_no_gradient, scan_stop_y);
+        clip_loop(loop_external, gterm, 0, gterm->framebuffer.width, 0, margin_no_gradient, band_start, band_end);
+        clip_loop(loop_external, gterm, 0, gterm->framebuffer.width, scan_stop_y, gterm->framebuffer.height, band_start, band_end);
+        clip_loop(loop_external, gterm, 0, margin_no_gradient, margin_no_gradient, scan_stop_y, band_start, band_end);
+        clip_loop(loop_external, gterm, scan_stop_x, gterm->framebuffer.width, margin_no_gradient, scan_stop_y, band_start, band_end);
 
         size_t gradient_stop_x = gterm->framebuffer.width - gterm->margin;
         size_t gradient_stop_y = gterm->framebuffer.height - gterm->margin;
 
         if (gterm->margin_gradient)
         {
-            loop_margin(gterm, margin_no_gradient, scan_stop_x, margin_no_gradient, gterm->margin);
-            loop_margin(gterm, margin_no_gradient, scan_stop_x, gradient_stop_y, scan_stop_y);
-            loop_margin(gterm, margin_no_gradient, gterm->margin, gterm->margin, gradient_stop_y);
-            loop_margin(gterm, gradient_stop_x, scan_stop_x, gterm->margin, gradient_stop_y);
+            clip_loop(loop_margin, gterm, margin_no_gradient, scan_stop_x, margin_no_gradient, gterm->margin, band_start, band_end);
+            clip_loop(loop_margin, gterm, margin_no_gradient, scan_stop_x, gradient_stop_y, scan_stop_y, band_start, band_end);
+            clip_loop(loop_margin, gterm, margin_no_gradient, gterm->margin, gterm->margin, gradient_stop_y, band_start, band_end);
+            clip_loop(loop_margin, gterm, gradient_stop_x, scan_stop_x, gterm->margin, gradient_stop_y, band_start, band_end);
         }
 
-        loop_internal(gterm, gterm->margin, gradient_stop_x, gterm->margin, gradient_stop_y);
+        clip_loop(loop_internal, gterm, gterm->margin, gradient_stop_x, gterm->margin, gradient_stop_y, band_start, band_end);
     }
     else
     {
-        for (size_t y = 0; y < gterm->framebuffer.height; y++)
+        for (size_t y = band_start; y < band_end; y++)
         {
             for (size_t x = 0; x < gterm->framebuffer.width; x++)
             {
@@ -258,6 +316,386 @@ static void generate_canvas(struct gterm_t *gterm)
     }
 }
 
+static void generate_canvas(struct gterm_t *gterm)
+{
+    term_parallel_for(gterm->term, 0, gterm->framebuffer.height, generate_canvas_band, gterm);
+}
+
+static const uint16_t cp437_unicode[FONT_GLYPHS] = {
+    0x0000, 0x263A, 0x263B, 0x2665, 0x2666, 0x2663, 0x2660, 0x2022, 0x25D8, 0x25CB, 0x25D9, 0x2642, 0x2640, 0x266A, 0x266B, 0x263C,
+    0x25BA, 0x25C4, 0x2195, 0x203C, 0x00B6, 0x00A7, 0x25AC, 0x21A8, 0x2191, 0x2193, 0x2192, 0x2190, 0x221F, 0x2194, 0x25B2, 0x25BC,
+    0x0020, 0x0021, 0x0022, 0x0023, 0x0024, 0x0025, 0x0026, 0x0027, 0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+    0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037, 0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+    0x0040, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047, 0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+    0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057, 0x0058, 0x0059, 0x005A, 0x005B, 0x005C, 0x005D, 0x005E, 0x005F,
+    0x0060, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067, 0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+    0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077, 0x0078, 0x0079, 0x007A, 0x007B, 0x007C, 0x007D, 0x007E, 0x2302,
+    0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7, 0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+    0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9, 0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+    0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA, 0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+    0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556, 0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+    0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F, 0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+    0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B, 0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+    0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4, 0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+    0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248, 0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
+};
+
+static bool font_lookup(struct gterm_t *gterm, uint32_t code_point, uint32_t *glyph)
+{
+    size_t lo = 0, hi = gterm->font_map_size;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (gterm->font_map[mid].code_point == code_point)
+        {
+            *glyph = gterm->font_map[mid].glyph;
+            return true;
+        }
+
+        if (gterm->font_map[mid].code_point < code_point)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return false;
+}
+
+// Box drawing glyphs (CP437 0xC0 to 0xDF) run on into the spacing columns
+static bool extends_right(struct gterm_t *gterm, uint32_t glyph)
+{
+    for (size_t i = 0xC0; i <= 0xDF; i++)
+        if (gterm->cp437_glyphs[i] == glyph)
+            return true;
+
+    return false;
+}
+
+// Masks hold the coverage of each pixel, 0 or 1 for bitmap fonts and up to coverage_max for
+// anti-aliased ones. Outline fonts draw the glyph straight into the mask.
+static void expand_glyph(struct gterm_t *gterm, uint32_t glyph, uint8_t *mask)
+{
+    bool extend = gterm->font_width > gterm->font_bits_width && extends_right(gterm, glyph);
+    size_t bpp = gterm->font_bpp;
+
+    if (gterm->font_render != NULL)
+    {
+        if (!gterm->font_render(gterm->font_renderer, glyph, mask, gterm->font_width))
+            memset(mask, 0, gterm->font_height * gterm->font_width);
+    }
+    else
+    {
+        const uint8_t *bits = &gterm->font_bits[glyph * gterm->font_row_bytes * gterm->font_height];
+        for (size_t y = 0; y < gterm->font_height; y++)
+        {
+            const uint8_t *row = &bits[y * gterm->font_row_bytes];
+            for (size_t x = 0; x < gterm->font_bits_width; x++)
+            {
+                size_t bit = x * bpp;
+                mask[y * gterm->font_width + x] = (row[bit / 8] >> (8 - bpp - bit % 8)) & gterm->coverage_max;
+            }
+        }
+    }
+
+    for (size_t y = 0; y < gterm->font_height; y++)
+    {
+        for (size_t x = gterm->font_bits_width; x < gterm->font_width; x++)
+            mask[y * gterm->font_width + x] = extend ? mask[y * gterm->font_width + gterm->font_bits_width - 1] : 0;
+    }
+}
+
+// Italic shears the rows towards the right as they go up, bold takes the larger coverage of a
+// pixel and its left neighbour, underline and strike-through set a whole row
+static void apply_attributes(struct gterm_t *gterm, uint32_t c, uint8_t *mask)
+{
+    size_t width = gterm->font_width, height = gterm->font_height;
+
+    for (size_t y = 0; y < height; y++)
+    {
+        uint8_t *row = &mask[y * width];
+        size_t shift = (c & TERM_ATTR_ITALIC) ? (height - 1 - y) / 4 : 0;
+        for (size_t x = width; x-- > 0; )
+        {
+            uint8_t px = x >= shift ? row[x - shift] : 0;
+            if ((c & TERM_ATTR_BOLD) && x >= shift + 1 && row[x - shift - 1] > px)
+                px = row[x - shift - 1];
+            row[x] = px;
+        }
+    }
+
+    if (c & TERM_ATTR_UNDERLINE)
+        for (size_t x = 0; x < width; x++)
+            mask[(height - 1) * width + x] = gterm->coverage_max;
+
+    if (c & TERM_ATTR_STRIKE)
+        for (size_t x = 0; x < width; x++)
+            mask[(height / 2) * width + x] = gterm->coverage_max;
+}
+
+// The first glyphs of the font are expanded up front, glyphs beyond them and attribute
+// variants go to the atlas the first time text using them is written. The atlas only grows,
+// up to GLYPH_ATLAS_PAGES pages. Terminals sharing the atlas may add glyphs at the same time,
+// so slots are claimed with an atomic counter and published in the hash once filled, which
+// also lets drawing (in parallel or on a render thread) look glyphs up without locking.
+static uint8_t *atlas_find(struct gterm_t *gterm, uint32_t key)
+{
+    struct gterm_glyphs *glyphs = gterm->glyphs;
+
+    for (size_t i = key * 2654435761u % GLYPH_ATLAS_HASH; ; i = (i + 1) % GLYPH_ATLAS_HASH)
+    {
+        uint32_t entry = __atomic_load_n(&glyphs->atlas_hash[i], __ATOMIC_ACQUIRE);
+        if (entry == 0)
+            return NULL;
+
+        size_t slot = entry - 1;
+        if (glyphs->atlas_keys[slot] == key)
+        {
+            uint8_t *page = __atomic_load_n(&glyphs->atlas_pages[slot / GLYPH_ATLAS_PAGE], __ATOMIC_ACQUIRE);
+            return &page[(slot % GLYPH_ATLAS_PAGE) * glyphs->glyph_size];
+        }
+    }
+}
+
+static uint8_t *atlas_insert(struct gterm_t *gterm, uint32_t key)
+{
+    struct gterm_glyphs *glyphs = gterm->glyphs;
+    uint8_t *mask = atlas_find(gterm, key);
+    if (mask != NULL)
+        return mask;
+
+    size_t slot = __atomic_load_n(&glyphs->atlas_used, __ATOMIC_RELAXED);
+    do
+    {
+        if (slot == GLYPH_ATLAS_PAGES * GLYPH_ATLAS_PAGE)
+            return NULL;
+    } while (!__atomic_compare_exchange_n(&glyphs->atlas_used, &slot, slot + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    size_t glyph_size = glyphs->glyph_size;
+    uint8_t *page = __atomic_load_n(&glyphs->atlas_pages[slot / GLYPH_ATLAS_PAGE], __ATOMIC_ACQUIRE);
+    if (page == NULL)
+    {
+        uint8_t *fresh = alloc_mem(GLYPH_ATLAS_PAGE * glyph_size);
+        if (fresh == NULL)
+            return NULL;
+
+        if (__atomic_compare_exchange_n(&glyphs->atlas_pages[slot / GLYPH_ATLAS_PAGE], &page, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            page = fresh;
+        else
+            free_mem(fresh, GLYPH_ATLAS_PAGE * glyph_size);
+    }
+
+    mask = &page[(slot % GLYPH_ATLAS_PAGE) * glyph_size];
+
+    // Variants start from the plain glyph when it is already expanded
+    uint32_t glyph = TERM_CELL_GLYPH(key);
+    const uint8_t *plain = glyph < gterm->font_mask_glyphs ? &glyphs->masks[glyph * glyph_size] : key != glyph ? atlas_find(gterm, glyph) : NULL;
+    if (plain != NULL)
+        memcpy(mask, plain, glyph_size);
+    else
+        expand_glyph(gterm, glyph, mask);
+    apply_attributes(gterm, key, mask);
+    glyphs->atlas_keys[slot] = key;
+
+    // Another terminal may publish the same glyph first, then this slot is left unused
+    for (size_t i = key * 2654435761u % GLYPH_ATLAS_HASH; ; i = (i + 1) % GLYPH_ATLAS_HASH)
+    {
+        uint32_t expected = 0;
+        if (__atomic_compare_exchange_n(&glyphs->atlas_hash[i], &expected, slot + 1, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+            return mask;
+        if (glyphs->atlas_keys[expected - 1] == key)
+            return atlas_find(gterm, key);
+    }
+}
+
+// Called as text is written, returns the character to store in the cell. Glyphs that cannot
+// be expanded any more are replaced, variants fall back to the plain glyph when drawn.
+static uint32_t prepare_glyph(struct gterm_t *gterm, uint32_t c)
+{
+    uint32_t glyph = TERM_CELL_GLYPH(c);
+    if (glyph >= gterm->font_glyphs)
+        c = (c & TERM_ATTR_MASK) | (glyph = gterm->cp437_glyphs[8]);
+
+    if ((glyph < gterm->font_mask_glyphs && (c & TERM_ATTR_MASK) == 0) || atlas_insert(gterm, c) != NULL)
+        return c;
+
+    if (glyph < gterm->font_mask_glyphs || atlas_find(gterm, glyph) != NULL)
+        return c;
+
+    return (c & TERM_ATTR_MASK) | gterm->cp437_glyphs[8];
+}
+
+static uint8_t *glyph_mask(struct gterm_t *gterm, uint32_t c)
+{
+    uint32_t glyph = TERM_CELL_GLYPH(c);
+    size_t glyph_size = gterm->glyphs->glyph_size;
+
+    if ((c & TERM_ATTR_MASK) == 0 && glyph < gterm->font_mask_glyphs)
+        return &gterm->glyphs->masks[glyph * glyph_size];
+
+    uint8_t *mask = atlas_find(gterm, c);
+    if (mask == NULL && glyph >= gterm->font_mask_glyphs)
+        mask = atlas_find(gterm, glyph);
+    if (mask != NULL)
+        return mask;
+
+    if (glyph >= gterm->font_mask_glyphs)
+        glyph = gterm->cp437_glyphs[8] < gterm->font_mask_glyphs ? gterm->cp437_glyphs[8] : 0;
+    return &gterm->glyphs->masks[glyph * glyph_size];
+}
+
+static uint32_t blend(uint32_t fg, uint32_t bg, uint32_t coverage, uint32_t max)
+{
+    uint32_t r = (((fg >> 16) & 0xFF) * coverage + ((bg >> 16) & 0xFF) * (max - coverage) + max / 2) / max;
+    uint32_t g = (((fg >> 8) & 0xFF) * coverage + ((bg >> 8) & 0xFF) * (max - coverage) + max / 2) / max;
+    uint32_t b = ((fg & 0xFF) * coverage + (bg & 0xFF) * (max - coverage) + max / 2) / max;
+    return (r << 16) | (g << 8) | b;
+}
+
+// Anti-aliased fonts draw opaque cells with a table of the colour for every coverage level,
+// made the first time a foreground and background pair is drawn. Like the atlas the tables
+// only grow, and as flushes may draw bands in parallel a table is claimed with an atomic
+// counter, filled and then published in the hash. Pairs past BLEND_TABLES, and cells with a
+// transparent colour, blend each pixel instead.
+static const uint32_t *blend_table(struct gterm_t *gterm, uint32_t fg, uint32_t bg)
+{
+    struct gterm_glyphs *glyphs = gterm->glyphs;
+    if (glyphs->blend_tables == NULL || fg == 0xFFFFFFFF || bg == 0xFFFFFFFF)
+        return NULL;
+
+    // fg is never 0xFFFFFFFF here, so no key is 0
+    uint64_t key = ((uint64_t)~fg << 32) | bg;
+    size_t levels = glyphs->levels;
+    size_t i = (key * 0x9E3779B97F4A7C15ull) >> 32;
+    size_t table = BLEND_TABLES;
+
+    for (size_t probes = 0; probes < BLEND_HASH; probes++, i++)
+    {
+        i %= BLEND_HASH;
+        uint32_t entry = __atomic_load_n(&glyphs->blend_hash[i], __ATOMIC_ACQUIRE);
+        if (entry != 0)
+        {
+            if (glyphs->blend_keys[entry - 1] == key)
+                return &glyphs->blend_tables[(entry - 1) * levels];
+            continue;
+        }
+
+        if (table == BLEND_TABLES)
+        {
+            table = __atomic_fetch_add(&glyphs->blend_used, 1, __ATOMIC_RELAXED);
+            if (table >= BLEND_TABLES)
+                return NULL;
+
+            for (size_t level = 0; level < levels; level++)
+                glyphs->blend_tables[table * levels + level] = blend(fg, bg, level, gterm->coverage_max);
+            glyphs->blend_keys[table] = key;
+        }
+
+        // Another band may publish the same pair first, then this table is left unused
+        uint32_t expected = 0;
+        if (__atomic_compare_exchange_n(&glyphs->blend_hash[i], &expected, table + 1, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+            return &glyphs->blend_tables[table * levels];
+        if (glyphs->blend_keys[expected - 1] == key)
+            return &glyphs->blend_tables[(expected - 1) * levels];
+    }
+
+    return NULL;
+}
+
+static void free_glyphs(struct gterm_glyphs *glyphs)
+{
+    if (glyphs->masks != NULL)
+        free_mem(glyphs->masks, glyphs->masks_size);
+
+    for (size_t i = 0; i < GLYPH_ATLAS_PAGES; i++)
+        if (glyphs->atlas_pages[i] != NULL)
+            free_mem(glyphs->atlas_pages[i], GLYPH_ATLAS_PAGE * glyphs->glyph_size);
+    if (glyphs->atlas_keys != NULL)
+        free_mem(glyphs->atlas_keys, GLYPH_ATLAS_PAGES * GLYPH_ATLAS_PAGE * sizeof(uint32_t));
+    if (glyphs->atlas_hash != NULL)
+        free_mem(glyphs->atlas_hash, GLYPH_ATLAS_HASH * sizeof(uint32_t));
+
+    if (glyphs->blend_tables != NULL)
+        free_mem(glyphs->blend_tables, BLEND_TABLES * glyphs->levels * sizeof(uint32_t));
+    if (glyphs->blend_keys != NULL)
+        free_mem(glyphs->blend_keys, BLEND_TABLES * sizeof(uint64_t));
+    if (glyphs->blend_hash != NULL)
+        free_mem(glyphs->blend_hash, BLEND_HASH * sizeof(uint32_t));
+
+    free_mem(glyphs, sizeof(struct gterm_glyphs));
+}
+
+// Expands the first glyphs of the font set up in gterm. Blend tables are only made for
+// anti-aliased fonts, and a font without them still works.
+static struct gterm_glyphs *create_glyphs(struct gterm_t *gterm)
+{
+    struct gterm_glyphs *glyphs = alloc_mem(sizeof(struct gterm_glyphs));
+    if (glyphs == NULL)
+        return NULL;
+
+    glyphs->users = 1;
+    glyphs->glyph_size = gterm->font_height * gterm->font_width;
+    glyphs->levels = (size_t)gterm->coverage_max + 1;
+
+    glyphs->masks_size = gterm->font_mask_glyphs * glyphs->glyph_size;
+    glyphs->masks = alloc_mem(glyphs->masks_size);
+    glyphs->atlas_keys = alloc_mem(GLYPH_ATLAS_PAGES * GLYPH_ATLAS_PAGE * sizeof(uint32_t));
+    glyphs->atlas_hash = alloc_mem(GLYPH_ATLAS_HASH * sizeof(uint32_t));
+    if (glyphs->masks == NULL || glyphs->atlas_keys == NULL || glyphs->atlas_hash == NULL)
+    {
+        free_glyphs(glyphs);
+        return NULL;
+    }
+
+    if (glyphs->levels > 2)
+    {
+        glyphs->blend_tables = alloc_mem(BLEND_TABLES * glyphs->levels * sizeof(uint32_t));
+        glyphs->blend_keys = alloc_mem(BLEND_TABLES * sizeof(uint64_t));
+        glyphs->blend_hash = alloc_mem(BLEND_HASH * sizeof(uint32_t));
+        if (glyphs->blend_tables == NULL || glyphs->blend_keys == NULL || glyphs->blend_hash == NULL)
+        {
+            if (glyphs->blend_tables != NULL)
+                free_mem(glyphs->blend_tables, BLEND_TABLES * glyphs->levels * sizeof(uint32_t));
+            if (glyphs->blend_keys != NULL)
+                free_mem(glyphs->blend_keys, BLEND_TABLES * sizeof(uint64_t));
+            if (glyphs->blend_hash != NULL)
+                free_mem(glyphs->blend_hash, BLEND_HASH * sizeof(uint32_t));
+            glyphs->blend_tables = NULL;
+            glyphs->blend_keys = NULL;
+            glyphs->blend_hash = NULL;
+        }
+    }
+
+    for (size_t i = 0; i < gterm->font_mask_glyphs; i++)
+        expand_glyph(gterm, i, &glyphs->masks[i * glyphs->glyph_size]);
+
+    return glyphs;
+}
+
+static void release_glyphs(struct gterm_glyphs *glyphs)
+{
+    if (__atomic_sub_fetch(&glyphs->users, 1, __ATOMIC_ACQ_REL) == 0)
+        free_glyphs(glyphs);
+}
+
+static void release_canvas(struct gterm_canvas *canvas)
+{
+    if (__atomic_sub_fetch(&canvas->users, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        free_mem(canvas->pixels, canvas->size);
+        free_mem(canvas, sizeof(struct gterm_canvas));
+    }
+}
+
+// Bitmap fonts only have the first two cases
+static inline uint32_t shade(struct gterm_t *gterm, const uint32_t *table, uint8_t coverage, uint32_t fg, uint32_t bg)
+{
+    if (coverage == 0)
+        return bg;
+    if (coverage == gterm->coverage_max)
+        return fg;
+    return table != NULL ? table[coverage] : blend(fg, bg, coverage, gterm->coverage_max);
+}
+
 static void plot_char(struct gterm_t *gterm, struct gterm_char *c, size_t x, size_t y)
 {
     if (x >= gterm->cols || y >= gterm->rows)
@@ -266,7 +704,10 @@ static void plot_char(struct gterm_t *gterm, struct gterm_char *c, size_t x, siz
     x = gterm->offset_x + x * gterm->glyph_width;
     y = gterm->offset_y + y * gterm->glyph_height;
 
-    bool *glyph = &gterm->font_bool[c->c * gterm->font_height * gterm->font_width];
+    uint8_t *glyph = glyph_mask(gterm, c->c);
+    uint32_t c_fg = resolve_colour(gterm, c->fg);
+    uint32_t c_bg = resolve_colour(gterm, c->bg);
+    const uint32_t *table = blend_table(gterm, c_fg, c_bg);
 
     for (size_t gy = 0; gy < gterm->glyph_height; gy++)
     {
@@ -275,13 +716,13 @@ static void plot_char(struct gterm_t *gterm, struct gterm_char *c, size_t x, siz
         uint32_t *canvas_line = gterm->bg_canvas + x + (y + gy) * gterm->framebuffer.width;
         for (size_t fx = 0; fx < gterm->font_width; fx++)
         {
-            bool draw = glyph[fy * gterm->font_width + fx];
+            uint8_t coverage = glyph[fy * gterm->font_width + fx];
             for (size_t i = 0; i < gterm->font_scale_x; i++)
             {
                 size_t gx = gterm->font_scale_x * fx + i;
-                uint32_t bg = c->bg == 0xFFFFFFFF ? canvas_line[gx] : c->bg;
-                uint32_t fg = c->fg == 0xFFFFFFFF ? canvas_line[gx] : c->fg;
-                fb_line[gx] = draw ? fg : bg;
+                uint32_t bg = c_bg == 0xFFFFFFFF ? canvas_line[gx] : c_bg;
+                uint32_t fg = c_fg == 0xFFFFFFFF ? canvas_line[gx] : c_fg;
+                fb_line[gx] = shade(gterm, table, coverage, fg, bg);
             }
         }
     }
@@ -295,8 +736,11 @@ static void plot_char_fast(struct gterm_t *gterm, struct gterm_char *old, struct
     x = gterm->offset_x + x * gterm->glyph_width;
     y = gterm->offset_y + y * gterm->glyph_height;
 
-    bool *new_glyph = &gterm->font_bool[c->c * gterm->font_height * gterm->font_width];
-    bool *old_glyph = &gterm->font_bool[old->c * gterm->font_height * gterm->font_width];
+    uint8_t *new_glyph = glyph_mask(gterm, c->c);
+    uint8_t *old_glyph = glyph_mask(gterm, old->c);
+    uint32_t c_fg = resolve_colour(gterm, c->fg);
+    uint32_t c_bg = resolve_colour(gterm, c->bg);
+    const uint32_t *table = blend_table(gterm, c_fg, c_bg);
     for (size_t gy = 0; gy < gterm->glyph_height; gy++)
     {
         uint8_t fy = gy / gterm->font_scale_y;
@@ -304,22 +748,35 @@ static void plot_char_fast(struct gterm_t *gterm, struct gterm_char *old, struct
         uint32_t *canvas_line = gterm->bg_canvas + x + (y + gy) * gterm->framebuffer.width;
         for (size_t fx = 0; fx < gterm->font_width; fx++)
         {
-            bool old_draw = old_glyph[fy * gterm->font_width + fx];
-            bool new_draw = new_glyph[fy * gterm->font_width + fx];
-            if (old_draw == new_draw)
+            uint8_t old_coverage = old_glyph[fy * gterm->font_width + fx];
+            uint8_t new_coverage = new_glyph[fy * gterm->font_width + fx];
+            if (old_coverage == new_coverage)
                 continue;
 
             for (size_t i = 0; i < gterm->font_scale_x; i++)
             {
                 size_t gx = gterm->font_scale_x * fx + i;
-                uint32_t bg = c->bg == 0xFFFFFFFF ? canvas_line[gx] : c->bg;
-                uint32_t fg = c->fg == 0xFFFFFFFF ? canvas_line[gx] : c->fg;
-                fb_line[gx] = new_draw ? fg : bg;
+                uint32_t bg = c_bg == 0xFFFFFFFF ? canvas_line[gx] : c_bg;
+                uint32_t fg = c_fg == 0xFFFFFFFF ? canvas_line[gx] : c_fg;
+                fb_line[gx] = shade(gterm, table, new_coverage, fg, bg);
             }
         }
     }
 }
 
+#define INVALID_CHAR 0xFFFFFFFF
+
+// Palette usage counts cover the cells on screen. They are only ever raised as cells are drawn,
+// so they overestimate until a palette change recounts them, which is all it takes to skip
+// the entries nothing on screen uses.
+static void count_colours(struct gterm_t *gterm, const struct gterm_char *c)
+{
+    if (IS_PALETTE_REF(c->fg))
+        __atomic_fetch_add(&gterm->palette_usage[c->fg & 0xFF], 1, __ATOMIC_RELAXED);
+    if (IS_PALETTE_REF(c->bg))
+        __atomic_fetch_add(&gterm->palette_usage[c->bg & 0xFF], 1, __ATOMIC_RELAXED);
+}
+
 static bool compare_char(struct gterm_char *a, struct gterm_char *b)
 {
     return !(a->c != b->c || a->bg != b->bg || a->fg != b->fg);
@@ -359,58 +816,10 @@ void gterm_scroll_enable(struct gterm_t *gterm)
     gterm->context.scroll_enabled = true;
 }
 
-void gterm_revscroll(struct gterm_t *gterm)
-{
-    for (size_t i = (gterm->term->context.scroll_bottom_margin - 1) * gterm->cols - 1; i >= gterm->term->context.scroll_top_margin * gterm->cols; i--)
-    {
-        if (i == (size_t)-1)
-            break;
-
-        struct gterm_char *c;
-        struct gterm_queue_item *q = gterm->map[i];
-        if (q != NULL)
-            c = &q->c;
-        else
-            c = &gterm->grid[i];
-
-        push_to_queue(gterm, c, (i + gterm->cols) % gterm->cols, (i + gterm->cols) / gterm->cols);
-    }
-
-    struct gterm_char empty;
-    empty.c  = ' ';
-    empty.fg = gterm->context.text_fg;
-    empty.bg = gterm->context.text_bg;
-
-    for (size_t i = 0; i < gterm->cols; i++)
-        push_to_queue(gterm, &empty, i, gterm->term->context.scroll_top_margin);
-}
-
-void gterm_scroll(struct gterm_t *gterm)
-{
-    for (size_t i = (gterm->term->context.scroll_top_margin + 1) * gterm->cols; i < gterm->term->context.scroll_bottom_margin * gterm->cols; i++)
-    {
-        struct gterm_char *c;
-        struct gterm_queue_item *q = gterm->map[i];
-        if (q != NULL)
-            c = &q->c;
-        else
-            c = &gterm->grid[i];
-        push_to_queue(gterm, c, (i - gterm->cols) % gterm->cols, (i - gterm->cols) / gterm->cols);
-    }
-
-    struct gterm_char empty;
-    empty.c  = ' ';
-    empty.fg = gterm->context.text_fg;
-    empty.bg = gterm->context.text_bg;
-
-    for (size_t i = 0; i < gterm->cols; i++)
-        push_to_queue(gterm, &empty, i, gterm->term->context.scroll_bottom_margin - 1);
-}
-
 void gterm_clear(struct gterm_t *gterm, bool move)
 {
     struct gterm_char empty;
-    empty.c  = ' ';
+    empty.c  = gterm->cp437_glyphs[' '];
     empty.fg = gterm->context.text_fg;
     empty.bg = gterm->context.text_bg;
     for (size_t i = 0; i < gterm->rows * gterm->cols; i++)
@@ -474,52 +883,53 @@ void gterm_move_character(struct gterm_t *gterm, size_t new_x, size_t new_y, siz
     push_to_queue(gterm, c, new_x, new_y);
 }
 
-void gterm_set_text_fg(struct gterm_t *gterm, size_t fg)
+// Copies the first rows cell rows of a move in an order that is safe for overlapping
+// regions and shrinks the move to what is left of it
+static void move_pixels(struct gterm_t *gterm, struct gterm_move *m, size_t rows)
 {
-    gterm->context.text_fg = gterm->ansi_colours[fg];
-}
+    size_t pitch = gterm->framebuffer.pitch / 4;
+    size_t width = m->width * gterm->glyph_width;
+    size_t height = rows * gterm->glyph_height;
 
-void gterm_set_text_bg(struct gterm_t *gterm, size_t bg)
-{
-    gterm->context.text_bg = gterm->ansi_colours[bg];
-}
+    volatile uint32_t *src = gterm->framebuffer_addr + gterm->offset_x + m->x * gterm->glyph_width + (gterm->offset_y + m->y * gterm->glyph_height) * pitch;
+    volatile uint32_t *dst = gterm->framebuffer_addr + gterm->offset_x + m->new_x * gterm->glyph_width + (gterm->offset_y + m->new_y * gterm->glyph_height) * pitch;
 
-void gterm_set_text_fg_bright(struct gterm_t *gterm, size_t fg)
-{
-    gterm->context.text_fg = gterm->ansi_bright_colours[fg];
-}
+    if (dst < src)
+    {
+        for (size_t y = 0; y < height; y++)
+            for (size_t x = 0; x < width; x++)
+                dst[y * pitch + x] = src[y * pitch + x];
 
-void gterm_set_text_bg_bright(struct gterm_t *gterm, size_t bg)
-{
-    gterm->context.text_bg = gterm->ansi_bright_colours[bg];
-}
+        m->y += rows;
+        m->new_y += rows;
+    }
+    else
+    {
+        src += (m->height - rows) * gterm->glyph_height * pitch;
+        dst += (m->height - rows) * gterm->glyph_height * pitch;
 
-void gterm_set_text_fg_rgb(struct gterm_t *gterm, uint32_t fg)
-{
-    gterm->context.text_fg = fg;
-}
+        for (size_t y = height; y-- > 0; )
+            for (size_t x = width; x-- > 0; )
+                dst[y * pitch + x] = src[y * pitch + x];
+    }
 
-void gterm_set_text_bg_rgb(struct gterm_t *gterm, uint32_t bg)
-{
-    gterm->context.text_bg = bg;
+    m->height -= rows;
 }
 
-void gterm_set_text_fg_default(struct gterm_t *gterm)
+static void apply_moves(struct gterm_t *gterm)
 {
-    gterm->context.text_fg = gterm->default_fg;
-}
+    for (size_t i = 0; i < gterm->moves_i; i++)
+        move_pixels(gterm, &gterm->moves[i], gterm->moves[i].height);
 
-void gterm_set_text_bg_default(struct gterm_t *gterm)
-{
-    gterm->context.text_bg = 0xFFFFFFFF;
+    gterm->moves_i = 0;
 }
 
-static void draw_cursor(struct gterm_t *gterm)
+static void invalidate_char(struct gterm_t *gterm, size_t x, size_t y)
 {
-    if (gterm->context.cursor_x >= gterm->cols || gterm->context.cursor_y >= gterm->rows)
+    if (x >= gterm->cols || y >= gterm->rows)
         return;
 
-    size_t i = gterm->context.cursor_x + gterm->context.cursor_y * gterm->cols;
+    size_t i = y * gterm->cols + x;
 
     struct gterm_char c;
     struct gterm_queue_item *q = gterm->map[i];
@@ -528,260 +938,1959 @@ static void draw_cursor(struct gterm_t *gterm)
     else
         c = gterm->grid[i];
 
-    uint32_t tmp = c.fg;
-    c.fg = c.bg;
-    c.bg = tmp;
-    plot_char(gterm, &c, gterm->context.cursor_x, gterm->context.cursor_y);
-    if (q != NULL)
-    {
-        gterm->grid[i] = q->c;
-        gterm->map[i] = NULL;
-    }
+    gterm->grid[i].c = INVALID_CHAR;
+    push_to_queue(gterm, &c, x, y);
 }
 
-void gterm_double_buffer_flush(struct gterm_t *gterm)
+// Recounts palette usage over the screen and queues a redraw of the cells that use one of
+// the changed entries
+static void retint(struct gterm_t *gterm, const bool *changed)
 {
-    if (gterm->context.cursor_status)
-        draw_cursor(gterm);
+    memset(gterm->palette_usage, 0, sizeof(gterm->palette_usage));
 
-    for (size_t i = 0; i < gterm->queue_i; i++)
+    for (size_t i = 0; i < gterm->rows * gterm->cols; i++)
     {
-        struct gterm_queue_item *q = &gterm->queue[i];
-        size_t offset = q->y * gterm->cols + q->x;
-        if (gterm->map[offset] == NULL)
-            continue;
+        struct gterm_char *c = &gterm->grid[i];
+        count_colours(gterm, c);
 
-        struct gterm_char *old = &gterm->grid[offset];
-        if (q->c.bg == old->bg && q->c.fg == old->fg)
-            plot_char_fast(gterm, old, &q->c, q->x, q->y);
-        else
-            plot_char(gterm, &q->c, q->x, q->y);
+        if (changed == NULL || c->c == INVALID_CHAR)
+            continue;
 
-        gterm->grid[offset] = q->c;
-        gterm->map[offset] = NULL;
+        if ((IS_PALETTE_REF(c->fg) && changed[c->fg & 0xFF]) || (IS_PALETTE_REF(c->bg) && changed[c->bg & 0xFF]))
+            invalidate_char(gterm, i % gterm->cols, i / gterm->cols);
     }
+}
 
-    if ((gterm->old_cursor_x != gterm->context.cursor_x || gterm->old_cursor_y != gterm->context.cursor_y) || gterm->context.cursor_status == false)
-        if (gterm->old_cursor_x < gterm->cols && gterm->old_cursor_y < gterm->rows)
-            plot_char(gterm, &gterm->grid[gterm->old_cursor_x + gterm->old_cursor_y * gterm->cols], gterm->old_cursor_x, gterm->old_cursor_y);
-
-    gterm->old_cursor_x = gterm->context.cursor_x;
-    gterm->old_cursor_y = gterm->context.cursor_y;
+static void load_palette(struct gterm_t *gterm)
+{
+    for (size_t i = 0; i < 8; i++)
+    {
+        gterm->palette[i] = gterm->ansi_colours[i];
+        gterm->palette[i + 8] = gterm->ansi_bright_colours[i];
+    }
 
-    gterm->queue_i = 0;
+    for (size_t i = 16; i < 256; i++)
+        gterm->palette[i] = col256[i - 16];
 }
 
-void gterm_putchar(struct gterm_t *gterm, uint8_t c)
+static void push_move(struct gterm_t *gterm, size_t x, size_t y, size_t width, size_t height, size_t new_x, size_t new_y)
 {
-    struct gterm_char ch;
-    ch.c = c;
-    ch.fg = gterm->context.text_fg;
-    ch.bg = gterm->context.text_bg;
-    push_to_queue(gterm, &ch, gterm->context.cursor_x++, gterm->context.cursor_y);
-    if (gterm->context.cursor_x >= gterm->cols && (gterm->context.cursor_y < gterm->term->context.scroll_bottom_margin - 1 || gterm->context.scroll_enabled))
+    if (gterm->moves_i == MAX_PENDING_MOVES)
+        apply_moves(gterm);
+
+    // The cursor is drawn straight to the framebuffer and would travel along with the pixels
+    if (gterm->moves_i == 0 && gterm->cursor_drawn)
     {
-        gterm->context.cursor_x = 0;
-        gterm->context.cursor_y++;
-        if (gterm->context.cursor_y == gterm->term->context.scroll_bottom_margin)
-        {
-            gterm->context.cursor_y--;
-            gterm_scroll(gterm);
-        }
-        if (gterm->context.cursor_y >= gterm->cols)
-            gterm->context.cursor_y = gterm->cols - 1;
+        invalidate_char(gterm, gterm->old_cursor_x, gterm->old_cursor_y);
+        gterm->cursor_drawn = false;
     }
+
+    struct gterm_move *m = &gterm->moves[gterm->moves_i++];
+    m->x = x;
+    m->y = y;
+    m->width = width;
+    m->height = height;
+    m->new_x = new_x;
+    m->new_y = new_y;
 }
 
-bool gterm_init(struct gterm_t *gterm, struct term_t *term, struct framebuffer_t frm, struct font_t font, struct style_t style, struct background_t back)
+// Folds a shift into the last recorded move if that one shifted the same region the same way.
+// Cells exposed by the earlier shift are already invalid, so a single copy by the combined
+// distance leaves the framebuffer in the same state as replaying both.
+static bool merge_move(struct gterm_t *gterm, size_t x, size_t y, size_t width, size_t height, size_t count, bool vertical, bool forward)
 {
-    if (font.address == 0)
+    if (gterm->moves_i == 0)
         return false;
 
-    gterm->term = term;
-    gterm->framebuffer = frm;
-    gterm->framebuffer_addr = (volatile uint32_t*)frm.address;
+    struct gterm_move *m = &gterm->moves[gterm->moves_i - 1];
 
-    gterm->context.cursor_status = true;
-    gterm->context.scroll_enabled = true;
+    if (vertical ? (m->x != x || m->new_x != x || m->width != width) : (m->y != y || m->new_y != y || m->height != height))
+        return false;
 
-    gterm->margin = 64;
-    gterm->margin_gradient = 4;
+    size_t *pos = vertical ? &m->y : &m->x;
+    size_t *new_pos = vertical ? &m->new_y : &m->new_x;
+    size_t *len = vertical ? &m->height : &m->width;
+    size_t start = vertical ? y : x;
+    size_t end = start + (vertical ? height : width);
 
-    memcpy(gterm->ansi_colours, style.ansi_colours, 32);
-    memcpy(gterm->ansi_bright_colours, style.ansi_bright_colours, 32);
+    if (forward ? (*pos != start || *new_pos <= *pos || *new_pos + *len != end) : (*new_pos != start || *pos <= *new_pos || *pos + *len != end))
+        return false;
 
-    gterm->default_bg = style.background;
-    gterm->default_fg = style.foreground & 0xFFFFFF;
+    // Nothing that was on screen survives, every cell of the region gets redrawn anyway
+    if (*len <= count)
+    {
+        gterm->moves_i--;
+        return true;
+    }
 
-    gterm->context.text_fg = gterm->default_fg;
-    gterm->context.text_bg = 0xFFFFFFFF;
+    if (forward)
+        *new_pos += count;
+    else
+        *pos += count;
+    *len -= count;
 
-    gterm->background = back.background;
+    return true;
+}
 
-    if (gterm->background == NULL)
+static void reverse_lane(struct gterm_t *gterm, size_t start, size_t stride, size_t len)
+{
+    for (size_t i = 0; i < len / 2; i++)
     {
-        gterm->margin = 0;
-        gterm->margin_gradient = 0;
+        struct gterm_queue_item **a = &gterm->map[start + i * stride];
+        struct gterm_queue_item **b = &gterm->map[start + (len - 1 - i) * stride];
+        struct gterm_queue_item *tmp = *a;
+        *a = *b;
+        *b = tmp;
     }
-    else if (gterm->default_bg == DEFAULT_BACKGROUND)
-        gterm->default_bg = 0x68000000;
+}
 
-    if (style.margin != (uint16_t)(-1))
-        gterm->margin = style.margin;
-    if (style.margin_gradient != (uint16_t)(-1))
-        gterm->margin_gradient = style.margin_gradient;
+// Shifts the grid and the pending queue items of one lane along with the pixels of a
+// recorded move. Queue items that fall off the end are reused for the exposed cells.
+static void shift_lane_pixels(struct gterm_t *gterm, size_t start, size_t stride, size_t len, size_t count, bool forward)
+{
+    reverse_lane(gterm, start, stride, len);
+    if (forward)
+    {
+        reverse_lane(gterm, start, stride, count);
+        reverse_lane(gterm, start + count * stride, stride, len - count);
 
-    if (gterm->background != NULL)
+        for (size_t i = len - 1; i >= count; i--)
+            gterm->grid[start + i * stride] = gterm->grid[start + (i - count) * stride];
+        for (size_t i = 0; i < count; i++)
+            gterm->grid[start + i * stride].c = INVALID_CHAR;
+    }
+    else
     {
-        if (back.style == CENTERED)
-            image_make_centered(gterm->background, gterm->framebuffer.width, gterm->framebuffer.height, back.backdrop);
-        else if (back.style == STRETCHED)
-            image_make_stretched(gterm->background, gterm->framebuffer.width, gterm->framebuffer.height);
+        reverse_lane(gterm, start, stride, len - count);
+        reverse_lane(gterm, start + (len - count) * stride, stride, count);
+
+        for (size_t i = 0; i < len - count; i++)
+            gterm->grid[start + i * stride] = gterm->grid[start + (i + count) * stride];
+        for (size_t i = len - count; i < len; i++)
+            gterm->grid[start + i * stride].c = INVALID_CHAR;
     }
 
-    gterm->font_width = font.width;
-    gterm->font_height = font.height;
+    for (size_t i = 0; i < len; i++)
+    {
+        size_t j = start + i * stride;
+        struct gterm_queue_item *q = gterm->map[j];
+        if (q != NULL)
+        {
+            q->x = j % gterm->cols;
+            q->y = j / gterm->cols;
+        }
+    }
+}
+
+static void shift_lane_queue(struct gterm_t *gterm, size_t start, size_t stride, size_t len, size_t count, bool forward)
+{
+    for (size_t n = 0; n < len - count; n++)
+    {
+        size_t i = forward ? len - 1 - n : n;
+        size_t src = start + (forward ? i - count : i + count) * stride;
+        size_t dst = start + i * stride;
+
+        struct gterm_char c;
+        struct gterm_queue_item *q = gterm->map[src];
+        if (q != NULL)
+            c = q->c;
+        else
+            c = gterm->grid[src];
 
-    gterm->font_bytes = (gterm->font_width * gterm->font_height * FONT_GLYPHS) / 8;
+        push_to_queue(gterm, &c, dst % gterm->cols, dst / gterm->cols);
+    }
+}
 
-    gterm->font_bits = alloc_mem(gterm->font_bytes);
-    memcpy(gterm->font_bits, (void*)font.address, gterm->font_bytes);
+// Moves the contents of a region by count cells along one axis and blanks the exposed cells.
+// With a flat canvas the move is replayed on the framebuffer at flush time instead of
+// redrawing every moved glyph.
+static void shift_region(struct gterm_t *gterm, size_t x, size_t y, size_t width, size_t height, size_t count, bool vertical, bool forward)
+{
+    size_t lanes = vertical ? width : height;
+    size_t len = vertical ? height : width;
+    size_t stride = vertical ? gterm->cols : 1;
+    size_t lane_step = vertical ? 1 : gterm->cols;
 
-    gterm->font_width += font.spacing;
+    if (count > len)
+        count = len;
 
-    gterm->font_bool_size = FONT_GLYPHS * gterm->font_height * gterm->font_width * sizeof(bool);
-    gterm->font_bool = alloc_mem(gterm->font_bool_size);
+    bool pixels = gterm->background == NULL && count < len;
 
-    for (size_t i = 0; i < FONT_GLYPHS; i++)
+    // Nothing is drawn while hidden, scrolled back or while a split renderer owns the
+    // framebuffer, the grid alone is shifted
+    if (pixels && !gterm->term->hidden && !gterm->term->split_render && gterm->sb_offset == 0 && !merge_move(gterm, x, y, width, height, count, vertical, forward))
+    {
+        if (vertical && forward)
+            push_move(gterm, x, y, width, height - count, x, y + count);
+        else if (vertical)
+            push_move(gterm, x, y + count, width, height - count, x, y);
+        else if (forward)
+            push_move(gterm, x, y, width - count, height, x + count, y);
+        else
+            push_move(gterm, x + count, y, width - count, height, x, y);
+    }
+
+    struct gterm_char empty;
+    empty.c  = gterm->cp437_glyphs[' '];
+    empty.fg = gterm->context.text_fg;
+    empty.bg = gterm->context.text_bg;
+
+    for (size_t l = 0; l < lanes; l++)
     {
-        uint8_t *glyph = &gterm->font_bits[i * gterm->font_height];
+        size_t start = y * gterm->cols + x + l * lane_step;
 
-        for (size_t y = 0; y < gterm->font_height; y++)
+        if (pixels)
+            shift_lane_pixels(gterm, start, stride, len, count, forward);
+        else
+            shift_lane_queue(gterm, start, stride, len, count, forward);
+
+        for (size_t n = 0; n < count; n++)
         {
-            for (size_t x = 0; x < 8; x++)
-            {
-                size_t offset = i * gterm->font_height * gterm->font_width + y * gterm->font_width + x;
+            size_t i = start + (forward ? n : len - 1 - n) * stride;
+            push_to_queue(gterm, &empty, i % gterm->cols, i / gterm->cols);
+        }
+    }
+}
 
-                if ((glyph[y] & (0x80 >> x)))
-                    gterm->font_bool[offset] = true;
-                else
-                    gterm->font_bool[offset] = false;
-            }
+static struct gterm_char *logical_char(struct gterm_t *gterm, size_t i)
+{
+    struct gterm_queue_item *q = gterm->map[i];
+    return q != NULL ? &q->c : &gterm->grid[i];
+}
 
-            for (size_t x = 8; x < gterm->font_width; x++)
-            {
-                size_t offset = i * gterm->font_height * gterm->font_width + y * gterm->font_width + x;
+// Scrollback lines live in a byte ring, positions only ever grow and are wrapped on access.
+// A line is stored as its length and run count (2 bytes each), then one run of
+// { count (2 bytes), fg, bg, text attributes (1 byte) } per stretch of equal attributes, then
+// one byte per glyph. Lines using glyphs past the first 256 set SB_WIDE_GLYPHS in their length
+// and store three bytes per glyph instead.
+#define SB_RUN_SIZE 11
+#define SB_WIDE_GLYPHS 0x8000
 
-                if (i >= 0xC0 && i <= 0xDF)
-                    gterm->font_bool[offset] = (glyph[y] & 1);
-                else
-                    gterm->font_bool[offset] = false;
-            }
+static bool sb_same_run(struct gterm_char *a, struct gterm_char *b)
+{
+    return a->fg == b->fg && a->bg == b->bg && (a->c & TERM_ATTR_MASK) == (b->c & TERM_ATTR_MASK);
+}
+
+static void sb_put(struct gterm_t *gterm, size_t *pos, const void *src, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        gterm->sb_data[(*pos)++ % gterm->sb_data_size] = ((const uint8_t*)src)[i];
+}
+
+static void sb_get(struct gterm_t *gterm, size_t *pos, void *dst, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        ((uint8_t*)dst)[i] = gterm->sb_data[(*pos)++ % gterm->sb_data_size];
+}
+
+static void sb_push_row(struct gterm_t *gterm, size_t y)
+{
+    if (gterm->sb_data == NULL)
+        return;
+
+    struct gterm_char *row_start = NULL;
+    uint16_t runs = 0;
+    size_t glyph_bytes = 1;
+    for (size_t x = 0; x < gterm->cols; x++)
+    {
+        struct gterm_char *c = logical_char(gterm, y * gterm->cols + x);
+        if (row_start == NULL || !sb_same_run(c, row_start))
+        {
+            row_start = c;
+            runs++;
         }
+        if (TERM_CELL_GLYPH(c->c) >= FONT_GLYPHS)
+            glyph_bytes = 3;
     }
 
-    gterm->font_scale_x = 1;
-    gterm->font_scale_y = 1;
+    size_t len = 4 + runs * SB_RUN_SIZE + gterm->cols * glyph_bytes;
+    if (len > gterm->sb_data_size)
+        return;
 
-    if (font.scale_x || font.scale_y)
+    while (gterm->sb_count != 0 && (gterm->sb_head + len - gterm->sb_tail > gterm->sb_data_size || gterm->sb_count == gterm->sb_lines_size))
     {
-        gterm->font_scale_x = font.scale_x;
-        gterm->font_scale_y = font.scale_y;
-        if (gterm->font_scale_x > 8 || gterm->font_scale_y > 8)
+        gterm->sb_first++;
+        gterm->sb_count--;
+        gterm->sb_tail = gterm->sb_count != 0 ? gterm->sb_lines[gterm->sb_first % gterm->sb_lines_size] : gterm->sb_head;
+    }
+
+    gterm->sb_lines[(gterm->sb_first + gterm->sb_count++) % gterm->sb_lines_size] = gterm->sb_head;
+
+    uint16_t cols = gterm->cols | (glyph_bytes == 3 ? SB_WIDE_GLYPHS : 0);
+    sb_put(gterm, &gterm->sb_head, &cols, 2);
+    sb_put(gterm, &gterm->sb_head, &runs, 2);
+
+    for (size_t x = 0; x < gterm->cols; )
+    {
+        struct gterm_char *c = logical_char(gterm, y * gterm->cols + x);
+        uint16_t count = 0;
+        for (; x < gterm->cols; x++, count++)
         {
-            gterm->font_scale_x = 1;
-            gterm->font_scale_y = 1;
+            struct gterm_char *next = logical_char(gterm, y * gterm->cols + x);
+            if (!sb_same_run(next, c))
+                break;
         }
+
+        uint8_t attributes = (c->c & TERM_ATTR_MASK) >> 24;
+        sb_put(gterm, &gterm->sb_head, &count, 2);
+        sb_put(gterm, &gterm->sb_head, &c->fg, 4);
+        sb_put(gterm, &gterm->sb_head, &c->bg, 4);
+        sb_put(gterm, &gterm->sb_head, &attributes, 1);
     }
 
-    gterm->glyph_width = gterm->font_width * gterm->font_scale_x;
-    gterm->glyph_height = gterm->font_height * gterm->font_scale_y;
+    for (size_t x = 0; x < gterm->cols; x++)
+    {
+        uint32_t glyph = TERM_CELL_GLYPH(logical_char(gterm, y * gterm->cols + x)->c);
+        sb_put(gterm, &gterm->sb_head, &glyph, glyph_bytes);
+    }
 
-    gterm->cols = term->cols = (gterm->framebuffer.width - gterm->margin * 2) / gterm->glyph_width;
-    gterm->rows = term->rows = (gterm->framebuffer.height - gterm->margin * 2) / gterm->glyph_height;
+    // The viewport stays on the lines it shows, it loses its top line only once that is evicted
+    if (gterm->sb_offset != 0 && ++gterm->sb_offset > gterm->sb_count)
+        gterm->sb_offset = gterm->sb_count;
+}
 
-    gterm->offset_x = gterm->margin + ((gterm->framebuffer.width - gterm->margin * 2) % gterm->glyph_width) / 2;
-    gterm->offset_y = gterm->margin + ((gterm->framebuffer.height - gterm->margin * 2) % gterm->glyph_height) / 2;
+void gterm_revscroll(struct gterm_t *gterm)
+{
+    size_t top = gterm->term->context.scroll_top_margin;
+    size_t bottom = gterm->term->context.scroll_bottom_margin;
+    if (top >= bottom || bottom > gterm->rows)
+        return;
 
-    gterm->grid_size = gterm->rows * gterm->cols * sizeof(struct gterm_char);
-    gterm->grid = alloc_mem(gterm->grid_size);
+    shift_region(gterm, 0, top, gterm->cols, bottom - top, 1, true, true);
+}
 
-    gterm->queue_size = gterm->rows * gterm->cols * sizeof(struct gterm_queue_item);
-    gterm->queue = alloc_mem(gterm->queue_size);
-    gterm->queue_i = 0;
+void gterm_scroll(struct gterm_t *gterm)
+{
+    size_t top = gterm->term->context.scroll_top_margin;
+    size_t bottom = gterm->term->context.scroll_bottom_margin;
+    if (top >= bottom || bottom > gterm->rows)
+        return;
 
-    gterm->map_size = gterm->rows * gterm->cols * sizeof(struct gterm_queue_item*);
-    gterm->map = alloc_mem(gterm->map_size);
+    // Only lines leaving the top of the main screen are history, not those of a scroll region
+    if (top == 0 && !gterm->term->context.alt_screen)
+        sb_push_row(gterm, 0);
 
-    gterm->bg_canvas_size = gterm->framebuffer.width * gterm->framebuffer.height * sizeof(uint32_t);
-    gterm->bg_canvas = alloc_mem(gterm->bg_canvas_size);
+    shift_region(gterm, 0, top, gterm->cols, bottom - top, 1, true, false);
+}
 
-    generate_canvas(gterm);
-    gterm_clear(gterm, true);
-    gterm_double_buffer_flush(gterm);
+void gterm_insert_chars(struct gterm_t *gterm, size_t x, size_t y, size_t count)
+{
+    if (x >= gterm->cols || y >= gterm->rows || count == 0)
+        return;
 
-    return true;
+    shift_region(gterm, x, y, gterm->cols - x, 1, count, false, true);
 }
 
-void gterm_deinit(struct gterm_t *gterm)
+void gterm_delete_chars(struct gterm_t *gterm, size_t x, size_t y, size_t count)
 {
-    free_mem(gterm->font_bits, gterm->font_bytes);
-    free_mem(gterm->font_bool, gterm->font_bool_size);
-    free_mem(gterm->grid, gterm->grid_size);
-    free_mem(gterm->queue, gterm->queue_size);
-    free_mem(gterm->map, gterm->map_size);
-    free_mem(gterm->bg_canvas, gterm->bg_canvas_size);
+    if (x >= gterm->cols || y >= gterm->rows || count == 0)
+        return;
+
+    shift_region(gterm, x, y, gterm->cols - x, 1, count, false, false);
 }
 
-uint64_t gterm_context_size(struct gterm_t *gterm)
+void gterm_insert_lines(struct gterm_t *gterm, size_t y, size_t count)
 {
-    uint64_t ret = 0;
+    size_t bottom = gterm->term->context.scroll_bottom_margin;
+    if (y < gterm->term->context.scroll_top_margin || y >= bottom || bottom > gterm->rows || count == 0)
+        return;
 
-    ret += sizeof(struct gterm_context);
-    ret += gterm->grid_size;
+    shift_region(gterm, 0, y, gterm->cols, bottom - y, count, true, true);
+}
 
-    return ret;
+void gterm_delete_lines(struct gterm_t *gterm, size_t y, size_t count)
+{
+    size_t bottom = gterm->term->context.scroll_bottom_margin;
+    if (y < gterm->term->context.scroll_top_margin || y >= bottom || bottom > gterm->rows || count == 0)
+        return;
+
+    shift_region(gterm, 0, y, gterm->cols, bottom - y, count, true, false);
 }
 
-void gterm_context_save(struct gterm_t *gterm, uint64_t ptr)
+void gterm_set_text_fg(struct gterm_t *gterm, size_t fg)
 {
-    memcpy((void*)ptr, &gterm->context, sizeof(struct gterm_context));
-    ptr += sizeof(struct gterm_context);
+    gterm->context.text_fg = PALETTE_REF | fg;
+}
 
-    memcpy((void*)ptr, gterm->grid, gterm->grid_size);
+void gterm_set_text_bg(struct gterm_t *gterm, size_t bg)
+{
+    gterm->context.text_bg = PALETTE_REF | bg;
 }
 
-void gterm_context_restore(struct gterm_t *gterm, uint64_t ptr)
+void gterm_set_text_fg_bright(struct gterm_t *gterm, size_t fg)
 {
-    memcpy(&gterm->context, (void*)ptr, sizeof(struct gterm_context));
-    ptr += sizeof(struct gterm_context);
+    gterm->context.text_fg = PALETTE_REF | (fg + 8);
+}
 
-    memcpy(gterm->grid, (void*)ptr, gterm->grid_size);
+void gterm_set_text_bg_bright(struct gterm_t *gterm, size_t bg)
+{
+    gterm->context.text_bg = PALETTE_REF | (bg + 8);
+}
+
+void gterm_set_text_fg_indexed(struct gterm_t *gterm, size_t fg)
+{
+    gterm->context.text_fg = PALETTE_REF | (fg & 0xFF);
+}
+
+void gterm_set_text_bg_indexed(struct gterm_t *gterm, size_t bg)
+{
+    gterm->context.text_bg = PALETTE_REF | (bg & 0xFF);
+}
+
+void gterm_set_text_fg_rgb(struct gterm_t *gterm, uint32_t fg)
+{
+    gterm->context.text_fg = fg & 0xFFFFFF;
+}
+
+void gterm_set_text_bg_rgb(struct gterm_t *gterm, uint32_t bg)
+{
+    gterm->context.text_bg = bg & 0xFFFFFF;
+}
+
+void gterm_set_text_attributes(struct gterm_t *gterm, uint32_t attributes)
+{
+    gterm->context.text_attributes = attributes;
+}
+
+void gterm_set_text_fg_default(struct gterm_t *gterm)
+{
+    gterm->context.text_fg = gterm->default_fg;
+}
+
+void gterm_set_text_bg_default(struct gterm_t *gterm)
+{
+    gterm->context.text_bg = 0xFFFFFFFF;
+}
+
+// Block cursors invert the cell, underline and bar cursors are a strip in the foreground
+// colour, about an eighth of the cell thick. Only the pixels of the shape are touched, drawing
+// it with on == false puts the cell back.
+static void plot_cursor(struct gterm_t *gterm, struct gterm_char *c, size_t shape, size_t x, size_t y, bool on)
+{
+    size_t row_start = 0, cols = gterm->font_width;
+    if (shape == TERM_CURSOR_UNDERLINE)
+        row_start = gterm->font_height - (gterm->font_height >= 16 ? gterm->font_height / 8 : 1);
+    else if (shape == TERM_CURSOR_BAR)
+        cols = gterm->font_width >= 16 ? gterm->font_width / 8 : 1;
+
+    x = gterm->offset_x + x * gterm->glyph_width;
+    y = gterm->offset_y + y * gterm->glyph_height;
+
+    uint8_t *glyph = glyph_mask(gterm, c->c);
+    uint32_t c_fg = resolve_colour(gterm, c->fg);
+    uint32_t c_bg = resolve_colour(gterm, c->bg);
+    const uint32_t *table = blend_table(gterm, c_fg, c_bg);
 
-    for (size_t i = 0; i < (size_t)gterm->rows * gterm->cols; i++)
+    for (size_t gy = row_start * gterm->font_scale_y; gy < gterm->glyph_height; gy++)
     {
-        size_t x = i % gterm->cols;
-        size_t y = i / gterm->cols;
+        uint8_t fy = gy / gterm->font_scale_y;
+        volatile uint32_t *fb_line = gterm->framebuffer_addr + x + (y + gy) * (gterm->framebuffer.pitch / 4);
+        uint32_t *canvas_line = gterm->bg_canvas + x + (y + gy) * gterm->framebuffer.width;
+        for (size_t fx = 0; fx < cols; fx++)
+        {
+            uint8_t coverage = glyph[fy * gterm->font_width + fx];
+            if (on)
+                coverage = shape == TERM_CURSOR_BLOCK ? gterm->coverage_max - coverage : gterm->coverage_max;
 
-        plot_char(gterm, &gterm->grid[i], x, y);
+            for (size_t i = 0; i < gterm->font_scale_x; i++)
+            {
+                size_t gx = gterm->font_scale_x * fx + i;
+                uint32_t bg = c_bg == 0xFFFFFFFF ? canvas_line[gx] : c_bg;
+                uint32_t fg = c_fg == 0xFFFFFFFF ? canvas_line[gx] : c_fg;
+                fb_line[gx] = shade(gterm, table, coverage, fg, bg);
+            }
+        }
     }
+}
+
+static bool cursor_shown(struct gterm_t *gterm)
+{
+    return gterm->context.cursor_status && (!gterm->cursor_blink || gterm->cursor_blink_on);
+}
+
+// The overlays are drawn over what the grid says is on screen, so neither can be used while
+// framebuffer moves are pending
+static void draw_cursor(struct gterm_t *gterm)
+{
+    gterm->old_cursor_x = gterm->context.cursor_x;
+    gterm->old_cursor_y = gterm->context.cursor_y;
+
+    if (gterm->context.cursor_x >= gterm->cols || gterm->context.cursor_y >= gterm->rows)
+        return;
+
+    struct gterm_char *c = &gterm->grid[gterm->context.cursor_x + gterm->context.cursor_y * gterm->cols];
+    if (c->c == INVALID_CHAR)
+        return;
+
+    plot_cursor(gterm, c, gterm->cursor_shape, gterm->context.cursor_x, gterm->context.cursor_y, true);
+    gterm->cursor_drawn = true;
+    gterm->cursor_drawn_shape = gterm->cursor_shape;
+}
+
+static void erase_cursor(struct gterm_t *gterm)
+{
+    if (!gterm->cursor_drawn)
+        return;
+
+    gterm->cursor_drawn = false;
+    if (gterm->old_cursor_x >= gterm->cols || gterm->old_cursor_y >= gterm->rows)
+        return;
+
+    struct gterm_char *c = &gterm->grid[gterm->old_cursor_x + gterm->old_cursor_y * gterm->cols];
+    if (c->c == INVALID_CHAR)
+        return;
+
+    plot_cursor(gterm, c, gterm->cursor_drawn_shape, gterm->old_cursor_x, gterm->old_cursor_y, false);
+}
+
+// True if the cursor has to be taken off the screen before the queue is drawn: it is in the
+// wrong place or shape, or the cell under it is about to be redrawn
+static bool cursor_stale(struct gterm_t *gterm)
+{
+    if (!gterm->cursor_drawn)
+        return false;
+
+    if (!cursor_shown(gterm) || gterm->cursor_drawn_shape != gterm->cursor_shape)
+        return true;
 
-    if (gterm->context.cursor_status)
+    if (gterm->old_cursor_x != gterm->context.cursor_x || gterm->old_cursor_y != gterm->context.cursor_y)
+        return true;
+
+    return gterm->old_cursor_x < gterm->cols && gterm->old_cursor_y < gterm->rows
+        && gterm->map[gterm->old_cursor_x + gterm->old_cursor_y * gterm->cols] != NULL;
+}
+
+void gterm_set_cursor_shape(struct gterm_t *gterm, size_t shape, bool blink)
+{
+    if (shape > TERM_CURSOR_BAR)
+        shape = TERM_CURSOR_BLOCK;
+
+    gterm->cursor_shape = shape;
+    gterm->cursor_blink = blink;
+    gterm->cursor_blink_on = true;
+}
+
+// Blinking redraws the cursor overlay and nothing else. While moves are pending or the screen
+// is not drawn by the terminal the next flush takes care of it.
+bool gterm_cursor_tick(struct gterm_t *gterm)
+{
+    if (!gterm->cursor_blink)
+        return false;
+
+    gterm->cursor_blink_on = !gterm->cursor_blink_on;
+    if (!gterm->context.cursor_status)
+        return false;
+
+    if (gterm->term->hidden || gterm->term->split_render || gterm->sb_offset != 0 || gterm->moves_i != 0
+        || __atomic_load_n(&gterm->term->panic, __ATOMIC_RELAXED))
+        return true;
+
+    if (gterm->cursor_blink_on)
+    {
+        erase_cursor(gterm);
         draw_cursor(gterm);
+    }
+    else
+        erase_cursor(gterm);
+
+    return true;
 }
 
-void gterm_full_refresh(struct gterm_t *gterm)
+static bool budget_spent(struct gterm_t *gterm, size_t cells, size_t max_cells, uint64_t deadline)
 {
-    generate_canvas(gterm);
+    // Leave the screen to the panic path
+    if (__atomic_load_n(&gterm->term->panic, __ATOMIC_RELAXED))
+        return true;
 
-    for (size_t i = 0; i < gterm->rows * gterm->cols; i++)
+    if (max_cells != 0 && cells >= max_cells)
+        return true;
+
+    return deadline != 0 && gterm->term->clock(gterm->term) >= deadline;
+}
+
+// Drops the queue items that have been drawn so the next call starts at the front
+static void compact_queue(struct gterm_t *gterm, size_t from)
+{
+    size_t n = 0;
+    for (size_t i = from; i < gterm->queue_i; i++)
     {
-        size_t x = i % gterm->cols;
-        size_t y = i / gterm->cols;
+        struct gterm_queue_item *q = &gterm->queue[i];
+        size_t offset = q->y * gterm->cols + q->x;
+        if (gterm->map[offset] != q)
+            continue;
 
-        plot_char(gterm, &gterm->grid[i], x, y);
+        gterm->queue[n] = *q;
+        gterm->map[offset] = &gterm->queue[n++];
     }
 
-    if (gterm->context.cursor_status)
-        draw_cursor(gterm);
-}
\ No newline at end of file
+    gterm->queue_i = n;
+}
+
+static bool flush_item(struct gterm_t *gterm, struct gterm_queue_item *q)
+{
+    size_t offset = q->y * gterm->cols + q->x;
+    if (gterm->map[offset] == NULL)
+        return false;
+
+    struct gterm_char *old = &gterm->grid[offset];
+    if (old->c != INVALID_CHAR && q->c.bg == old->bg && q->c.fg == old->fg)
+        plot_char_fast(gterm, old, &q->c, q->x, q->y);
+    else
+        plot_char(gterm, &q->c, q->x, q->y);
+
+    // Snapshots read the grid once the item is gone, it has to be in place by then
+    gterm->grid[offset] = q->c;
+    __atomic_store_n(&gterm->map[offset], NULL, __ATOMIC_RELEASE);
+    count_colours(gterm, &q->c);
+    return true;
+}
+
+static void flush_band(void *ctx, size_t row_start, size_t row_end)
+{
+    struct gterm_t *gterm = ctx;
+
+    for (size_t i = 0; i < gterm->queue_i; i++)
+    {
+        struct gterm_queue_item *q = &gterm->queue[i];
+        if (q->y >= row_start && q->y < row_end)
+            flush_item(gterm, q);
+    }
+}
+
+// 0 marks a row that cannot be matched, either because part of it is not known to be on screen
+// or because it is not the row that is meant
+static uint32_t hash_row(struct gterm_t *gterm, size_t y, bool logical)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t x = 0; x < gterm->cols; x++)
+    {
+        size_t i = y * gterm->cols + x;
+        struct gterm_char *c = logical ? logical_char(gterm, i) : &gterm->grid[i];
+        if (c->c == INVALID_CHAR)
+            return 0;
+
+        hash = (hash ^ c->c) * 16777619u;
+        hash = (hash ^ c->fg) * 16777619u;
+        hash = (hash ^ c->bg) * 16777619u;
+    }
+
+    return hash | 1;
+}
+
+static bool rows_match(struct gterm_t *gterm, size_t old_y, size_t new_y)
+{
+    for (size_t x = 0; x < gterm->cols; x++)
+        if (!compare_char(&gterm->grid[old_y * gterm->cols + x], logical_char(gterm, new_y * gterm->cols + x)))
+            return false;
+
+    return true;
+}
+
+static size_t count_hash(uint32_t *hashes, size_t rows, uint32_t hash)
+{
+    size_t n = 0;
+    for (size_t y = 0; y < rows; y++)
+        n += hashes[y] == hash;
+    return n;
+}
+
+static size_t move_rows(struct gterm_t *gterm, struct gterm_move *m)
+{
+    struct gterm_move pixels = *m;
+    move_pixels(gterm, &pixels, pixels.height);
+
+    for (size_t n = 0; n < m->height; n++)
+    {
+        size_t k = m->new_y < m->y ? n : m->height - 1 - n;
+        struct gterm_char *dst = &gterm->grid[(m->new_y + k) * gterm->cols];
+        memcpy(dst, &gterm->grid[(m->y + k) * gterm->cols], gterm->cols * sizeof(struct gterm_char));
+
+        // Cells now matching the screen need no drawing
+        for (size_t x = 0; x < gterm->cols; x++)
+        {
+            count_colours(gterm, &dst[x]);
+
+            struct gterm_queue_item **q = &gterm->map[(m->new_y + k) * gterm->cols + x];
+            if (*q != NULL && compare_char(&(*q)->c, &dst[x]))
+                *q = NULL;
+        }
+    }
+
+    return m->height * gterm->cols;
+}
+
+// Applications that scroll by repainting leave every cell of the moved rows queued. Rows of
+// the pending screen that are found unchanged elsewhere on screen are moved there instead
+// of being drawn again: rows whose contents are unique on both sides anchor a match, which
+// is then extended to the neighbouring rows that agree. Matches that would cross an earlier
+// one are dropped, which lets the remaining moves run without overwriting each others'
+// sources, upwards moves from the top and downwards moves from the bottom.
+static size_t scroll_rows(struct gterm_t *gterm)
+{
+    size_t rows = gterm->rows;
+    uint32_t *old_hashes = gterm->row_hashes;
+    uint32_t *new_hashes = gterm->row_hashes + rows;
+
+    for (size_t y = 0; y < rows; y++)
+    {
+        old_hashes[y] = hash_row(gterm, y, false);
+        new_hashes[y] = hash_row(gterm, y, true);
+    }
+
+    size_t moves = 0;
+    size_t old_end = 0, new_end = 0;
+    for (size_t y = 0; y < rows; y++)
+    {
+        uint32_t hash = new_hashes[y];
+        if (hash == 0 || hash == old_hashes[y] || count_hash(new_hashes, rows, hash) != 1 || count_hash(old_hashes, rows, hash) != 1)
+            continue;
+
+        size_t o = 0;
+        while (old_hashes[o] != hash)
+            o++;
+
+        size_t start = y, old_start = o;
+        while (start > new_end && old_start > old_end && new_hashes[start - 1] != 0 && new_hashes[start - 1] == old_hashes[old_start - 1])
+        {
+            start--;
+            old_start--;
+        }
+
+        size_t len = y - start + 1;
+        while (y + 1 < rows && o + 1 < rows && new_hashes[y + 1] != 0 && new_hashes[y + 1] == old_hashes[o + 1])
+        {
+            y++;
+            o++;
+            len++;
+        }
+
+        if (old_start < old_end)
+            continue;
+
+        size_t verified = 0;
+        while (verified < len && rows_match(gterm, old_start + verified, start + verified))
+            verified++;
+        if (verified == 0)
+            continue;
+
+        struct gterm_move *m = &gterm->row_moves[moves++];
+        m->x = m->new_x = 0;
+        m->width = gterm->cols;
+        m->y = old_start;
+        m->new_y = start;
+        m->height = verified;
+
+        old_end = old_start + verified;
+        new_end = start + verified;
+    }
+
+    if (moves == 0)
+        return 0;
+
+    // The cursor is drawn straight to the framebuffer and would travel along with the pixels,
+    // so it is taken off while the grid still describes the screen
+    erase_cursor(gterm);
+
+    term_seq_begin(gterm->term);
+
+    size_t cells = 0;
+    for (size_t i = 0; i < moves; i++)
+        if (gterm->row_moves[i].new_y < gterm->row_moves[i].y)
+            cells += move_rows(gterm, &gterm->row_moves[i]);
+    for (size_t i = moves; i-- > 0; )
+        if (gterm->row_moves[i].new_y > gterm->row_moves[i].y)
+            cells += move_rows(gterm, &gterm->row_moves[i]);
+
+    // Drop the items of the cells that were moved into place
+    compact_queue(gterm, 0);
+
+    term_seq_end(gterm->term);
+
+    return cells;
+}
+
+bool gterm_flush_budget(struct gterm_t *gterm, size_t max_cells, uint64_t max_time)
+{
+    if (__atomic_load_n(&gterm->term->panic, __ATOMIC_RELAXED))
+        return false;
+
+    // The viewport is left alone while it shows history
+    if (gterm->sb_offset != 0)
+    {
+        gterm_logical_flush(gterm);
+        return true;
+    }
+
+    uint64_t deadline = 0;
+    if (max_time != 0 && gterm->term->clock != NULL)
+        deadline = gterm->term->clock(gterm->term) + max_time;
+
+    size_t cells = 0;
+
+    // Moves go first and one cell row at a time, the queued cells assume they are done
+    while (gterm->moves_i != 0)
+    {
+        struct gterm_move *m = &gterm->moves[0];
+        move_pixels(gterm, m, 1);
+        cells += m->width;
+
+        if (m->height == 0)
+        {
+            gterm->moves_i--;
+            for (size_t i = 0; i < gterm->moves_i; i++)
+                gterm->moves[i] = gterm->moves[i + 1];
+        }
+
+        if (budget_spent(gterm, cells, max_cells, deadline))
+        {
+            if (gterm->moves_i != 0 || gterm->queue_i != 0)
+                return false;
+        }
+    }
+
+    // Moves are only worth looking for when a large part of the screen is being redrawn, and
+    // pixels can only be moved over a flat canvas. They are made all at once, which a budget
+    // would not allow for.
+    if (gterm->background == NULL && max_cells == 0 && deadline == 0 && gterm->queue_i >= gterm->rows * gterm->cols / 4)
+        cells += scroll_rows(gterm);
+
+    if (cursor_stale(gterm))
+        erase_cursor(gterm);
+
+    // Large unlimited flushes are split into row bands, each cell has at most one queue item
+    if (max_cells == 0 && deadline == 0 && gterm->queue_i >= gterm->rows * gterm->cols / 4)
+        term_parallel_for(gterm->term, 0, gterm->rows, flush_band, gterm);
+    else
+    {
+        for (size_t i = 0; i < gterm->queue_i; i++)
+        {
+            if (!flush_item(gterm, &gterm->queue[i]))
+                continue;
+
+            if (budget_spent(gterm, ++cells, max_cells, deadline) && i + 1 < gterm->queue_i)
+            {
+                term_seq_begin(gterm->term);
+                compact_queue(gterm, i + 1);
+                term_seq_end(gterm->term);
+                return false;
+            }
+        }
+    }
+
+    if (__atomic_load_n(&gterm->term->panic, __ATOMIC_RELAXED))
+        return false;
+
+    // A moving cursor stays solid while it moves, an idle flush draws nothing
+    if (gterm->old_cursor_x != gterm->context.cursor_x || gterm->old_cursor_y != gterm->context.cursor_y)
+    {
+        term_seq_begin(gterm->term);
+        gterm->cursor_blink_on = true;
+        term_seq_end(gterm->term);
+    }
+
+    if (!gterm->cursor_drawn && cursor_shown(gterm))
+        draw_cursor(gterm);
+    else if (!gterm->cursor_drawn)
+    {
+        gterm->old_cursor_x = gterm->context.cursor_x;
+        gterm->old_cursor_y = gterm->context.cursor_y;
+    }
+
+    gterm->queue_i = 0;
+    return true;
+}
+
+void gterm_double_buffer_flush(struct gterm_t *gterm)
+{
+    gterm_flush_budget(gterm, 0, 0);
+}
+
+static bool can_wrap(struct gterm_t *gterm)
+{
+    return gterm->context.cursor_y < gterm->term->context.scroll_bottom_margin - 1 || gterm->context.scroll_enabled;
+}
+
+static void wrap_cursor(struct gterm_t *gterm)
+{
+    gterm->context.cursor_x = 0;
+    gterm->context.cursor_y++;
+    if (gterm->context.cursor_y == gterm->term->context.scroll_bottom_margin)
+    {
+        gterm->context.cursor_y--;
+        gterm_scroll(gterm);
+    }
+    if (gterm->context.cursor_y >= gterm->cols)
+        gterm->context.cursor_y = gterm->cols - 1;
+}
+
+static void put_glyph(struct gterm_t *gterm, uint32_t glyph)
+{
+    struct gterm_char ch;
+    ch.c = prepare_glyph(gterm, glyph | gterm->context.text_attributes);
+    ch.fg = gterm->context.text_fg;
+    ch.bg = gterm->context.text_bg;
+    push_to_queue(gterm, &ch, gterm->context.cursor_x++, gterm->context.cursor_y);
+    if (gterm->context.cursor_x >= gterm->cols && can_wrap(gterm))
+        wrap_cursor(gterm);
+}
+
+void gterm_putchar(struct gterm_t *gterm, uint8_t c)
+{
+    put_glyph(gterm, gterm->cp437_glyphs[c]);
+}
+
+// Returns false if the font has no glyph for the code point (or the atlas is full), the
+// caller then falls back to code page 437
+bool gterm_put_code_point(struct gterm_t *gterm, uint32_t code_point)
+{
+    uint32_t glyph;
+    if (!font_lookup(gterm, code_point, &glyph) || glyph >= gterm->font_glyphs)
+        return false;
+
+    if (glyph >= gterm->font_mask_glyphs && atlas_insert(gterm, glyph) == NULL)
+        return false;
+
+    put_glyph(gterm, glyph);
+    return true;
+}
+
+void gterm_repeat_char(struct gterm_t *gterm, uint8_t c, size_t count)
+{
+    struct gterm_char ch;
+    ch.c = prepare_glyph(gterm, gterm->cp437_glyphs[c] | gterm->context.text_attributes);
+    ch.fg = gterm->context.text_fg;
+    ch.bg = gterm->context.text_bg;
+
+    while (count != 0)
+    {
+        if (gterm->context.cursor_x >= gterm->cols)
+        {
+            gterm->context.cursor_x += count;
+            return;
+        }
+
+        size_t run = gterm->cols - gterm->context.cursor_x;
+        if (run > count)
+            run = count;
+
+        for (size_t i = 0; i < run; i++)
+            push_to_queue(gterm, &ch, gterm->context.cursor_x + i, gterm->context.cursor_y);
+
+        gterm->context.cursor_x += run;
+        count -= run;
+
+        if (gterm->context.cursor_x >= gterm->cols && can_wrap(gterm))
+            wrap_cursor(gterm);
+    }
+}
+
+// Attached terminals take the glyphs of source, and its canvas when the framebuffers are the
+// same size
+static bool init(struct gterm_t *gterm, struct term_t *term, struct framebuffer_t frm, struct font_t font, struct style_t style, struct background_t back, const struct gterm_share *share)
+{
+    if (font.address == 0 && font.render == NULL)
+        return false;
+
+    gterm->term = term;
+    gterm->font = font;
+    gterm->style = style;
+    gterm->back = back;
+    gterm->framebuffer = frm;
+    gterm->framebuffer_addr = (volatile uint32_t*)frm.address;
+
+    gterm->context.cursor_status = true;
+    gterm->context.scroll_enabled = true;
+
+    gterm->cursor_shape = TERM_CURSOR_BLOCK;
+    gterm->cursor_blink = false;
+    gterm->cursor_blink_on = true;
+    gterm->cursor_drawn = false;
+
+    gterm->margin = 64;
+    gterm->margin_gradient = 4;
+
+    memcpy(gterm->ansi_colours, style.ansi_colours, 32);
+    memcpy(gterm->ansi_bright_colours, style.ansi_bright_colours, 32);
+
+    load_palette(gterm);
+    memset(gterm->palette_usage, 0, sizeof(gterm->palette_usage));
+
+    gterm->default_bg = style.background;
+    gterm->default_fg = style.foreground & 0xFFFFFF;
+
+    gterm->context.text_fg = gterm->default_fg;
+    gterm->context.text_bg = 0xFFFFFFFF;
+    gterm->context.text_attributes = 0;
+
+    gterm->background = back.background;
+
+    if (gterm->background == NULL)
+    {
+        gterm->margin = 0;
+        gterm->margin_gradient = 0;
+    }
+    else if (gterm->default_bg == DEFAULT_BACKGROUND)
+        gterm->default_bg = 0x68000000;
+
+    if (style.margin != (uint16_t)(-1))
+        gterm->margin = style.margin;
+    if (style.margin_gradient != (uint16_t)(-1))
+        gterm->margin_gradient = style.margin_gradient;
+
+    if (gterm->background != NULL)
+    {
+        if (back.style == CENTERED)
+            image_make_centered(gterm->background, gterm->framebuffer.width, gterm->framebuffer.height, back.backdrop);
+        else if (back.style == STRETCHED)
+            image_make_stretched(gterm->background, gterm->framebuffer.width, gterm->framebuffer.height);
+    }
+
+    gterm->font_width = font.width;
+    gterm->font_height = font.height;
+
+    gterm->font_glyphs = font.glyphs ? font.glyphs : FONT_GLYPHS;
+    gterm->font_bits_width = font.width;
+    gterm->font_bpp = font.render != NULL ? 8 : font.bpp == 2 || font.bpp == 4 || font.bpp == 8 ? font.bpp : 1;
+    gterm->coverage_max = (1 << gterm->font_bpp) - 1;
+    gterm->font_row_bytes = (font.width * gterm->font_bpp + 7) / 8;
+    gterm->font_bits = (const uint8_t*)font.address;
+    gterm->font_render = font.render;
+    gterm->font_renderer = font.renderer;
+
+    gterm->font_map = font.map_size != 0 ? font.map : NULL;
+    gterm->font_map_size = gterm->font_map != NULL ? font.map_size : 0;
+
+    for (size_t i = 0; i < FONT_GLYPHS; i++)
+    {
+        uint32_t glyph = i;
+        if (gterm->font_map != NULL && !font_lookup(gterm, cp437_unicode[i], &glyph) && !font_lookup(gterm, '?', &glyph))
+            glyph = 0;
+        gterm->cp437_glyphs[i] = glyph < gterm->font_glyphs ? glyph : 0;
+    }
+
+    gterm->font_width += font.spacing;
+
+    // Outline fonts only draw glyph 0 up front, the others go to the atlas
+    gterm->font_mask_glyphs = gterm->font_glyphs < FONT_GLYPHS ? gterm->font_glyphs : FONT_GLYPHS;
+    if (gterm->font_render != NULL)
+        gterm->font_mask_glyphs = 1;
+
+    if (share != NULL)
+    {
+        gterm->glyphs = share->glyphs;
+        __atomic_add_fetch(&gterm->glyphs->users, 1, __ATOMIC_RELAXED);
+    }
+    else if ((gterm->glyphs = create_glyphs(gterm)) == NULL)
+        return false;
+
+    // Printable ASCII is drawn up front as well, blank cells and panic output (which cannot
+    // allocate) need their glyphs
+    if (gterm->font_render != NULL && share == NULL)
+    {
+        for (size_t i = ' '; i < 0x7F; i++)
+            if (gterm->cp437_glyphs[i] != 0)
+                atlas_insert(gterm, gterm->cp437_glyphs[i]);
+        if (gterm->cp437_glyphs[8] != 0)
+            atlas_insert(gterm, gterm->cp437_glyphs[8]);
+    }
+
+    gterm->font_scale_x = 1;
+    gterm->font_scale_y = 1;
+
+    if (font.scale_x || font.scale_y)
+    {
+        gterm->font_scale_x = font.scale_x;
+        gterm->font_scale_y = font.scale_y;
+        if (gterm->font_scale_x > 8 || gterm->font_scale_y > 8)
+        {
+            gterm->font_scale_x = 1;
+            gterm->font_scale_y = 1;
+        }
+    }
+
+    gterm->glyph_width = gterm->font_width * gterm->font_scale_x;
+    gterm->glyph_height = gterm->font_height * gterm->font_scale_y;
+
+    gterm->cols = term->cols = (gterm->framebuffer.width - gterm->margin * 2) / gterm->glyph_width;
+    gterm->rows = term->rows = (gterm->framebuffer.height - gterm->margin * 2) / gterm->glyph_height;
+
+    gterm->offset_x = gterm->margin + ((gterm->framebuffer.width - gterm->margin * 2) % gterm->glyph_width) / 2;
+    gterm->offset_y = gterm->margin + ((gterm->framebuffer.height - gterm->margin * 2) % gterm->glyph_height) / 2;
+
+    gterm->grid_size = gterm->rows * gterm->cols * sizeof(struct gterm_char);
+    gterm->grid = alloc_mem(gterm->grid_size);
+
+    gterm->queue_size = gterm->rows * gterm->cols * sizeof(struct gterm_queue_item);
+    gterm->queue = alloc_mem(gterm->queue_size);
+    gterm->queue_i = 0;
+
+    gterm->map_size = gterm->rows * gterm->cols * sizeof(struct gterm_queue_item*);
+    gterm->map = alloc_mem(gterm->map_size);
+
+    gterm->moves_i = 0;
+
+    gterm->row_hashes = alloc_mem(gterm->rows * 2 * sizeof(uint32_t));
+    gterm->row_moves = alloc_mem(gterm->rows * sizeof(struct gterm_move));
+
+    gterm->sb_data = NULL;
+    gterm->sb_data_size = 0;
+    gterm->sb_lines = NULL;
+    gterm->sb_lines_size = 0;
+    gterm->sb_offset = 0;
+
+    gterm->alt_grid = NULL;
+
+    if (share != NULL && share->width == frm.width && share->height == frm.height)
+    {
+        gterm->canvas = share->canvas;
+        __atomic_add_fetch(&gterm->canvas->users, 1, __ATOMIC_RELAXED);
+        gterm->bg_canvas = gterm->canvas->pixels;
+        gterm_draw_background(gterm);
+    }
+    else
+    {
+        gterm->canvas = alloc_mem(sizeof(struct gterm_canvas));
+        gterm->canvas->users = 1;
+        gterm->canvas->size = gterm->framebuffer.width * gterm->framebuffer.height * sizeof(uint32_t);
+        gterm->canvas->pixels = alloc_mem(gterm->canvas->size);
+        gterm->bg_canvas = gterm->canvas->pixels;
+        generate_canvas(gterm);
+    }
+
+    gterm_clear(gterm, true);
+    gterm_double_buffer_flush(gterm);
+
+    return true;
+}
+
+bool gterm_init(struct gterm_t *gterm, struct term_t *term, struct framebuffer_t frm, struct font_t font, struct style_t style, struct background_t back)
+{
+    return init(gterm, term, frm, font, style, back, NULL);
+}
+
+bool gterm_attach(struct gterm_t *gterm, struct term_t *term, struct framebuffer_t frm, const struct gterm_share *share)
+{
+    return init(gterm, term, frm, share->font, share->style, share->back, share);
+}
+
+void gterm_share(struct gterm_t *gterm, struct gterm_share *share)
+{
+    share->glyphs = gterm->glyphs;
+    share->canvas = gterm->canvas;
+    __atomic_add_fetch(&share->glyphs->users, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&share->canvas->users, 1, __ATOMIC_RELAXED);
+
+    share->font = gterm->font;
+    share->style = gterm->style;
+    share->back = gterm->back;
+    share->width = gterm->framebuffer.width;
+    share->height = gterm->framebuffer.height;
+}
+
+void gterm_unshare(struct gterm_share *share)
+{
+    release_glyphs(share->glyphs);
+    release_canvas(share->canvas);
+}
+
+void gterm_deinit(struct gterm_t *gterm)
+{
+    release_glyphs(gterm->glyphs);
+    release_canvas(gterm->canvas);
+    free_mem(gterm->grid, gterm->grid_size);
+    free_mem(gterm->queue, gterm->queue_size);
+    free_mem(gterm->map, gterm->map_size);
+    free_mem(gterm->row_hashes, gterm->rows * 2 * sizeof(uint32_t));
+    free_mem(gterm->row_moves, gterm->rows * sizeof(struct gterm_move));
+
+    if (gterm->sb_data != NULL)
+    {
+        free_mem(gterm->sb_data, gterm->sb_data_size);
+        free_mem(gterm->sb_lines, gterm->sb_lines_size * sizeof(size_t));
+        gterm->sb_data = NULL;
+    }
+
+    if (gterm->alt_grid != NULL)
+    {
+        free_mem(gterm->alt_grid, gterm->grid_size);
+        gterm->alt_grid = NULL;
+    }
+}
+
+uint64_t gterm_context_size(struct gterm_t *gterm)
+{
+    uint64_t ret = 0;
+
+    ret += sizeof(struct gterm_context);
+    ret += gterm->grid_size;
+
+    return ret;
+}
+
+void gterm_context_save(struct gterm_t *gterm, uint64_t ptr)
+{
+    memcpy((void*)ptr, &gterm->context, sizeof(struct gterm_context));
+    ptr += sizeof(struct gterm_context);
+
+    memcpy((void*)ptr, gterm->grid, gterm->grid_size);
+
+    struct gterm_char *grid = (struct gterm_char*)ptr;
+    for (size_t i = 0; i < gterm->queue_i; i++)
+    {
+        struct gterm_queue_item *q = &gterm->queue[i];
+        size_t offset = q->y * gterm->cols + q->x;
+        if (gterm->map[offset] == q)
+            grid[offset] = q->c;
+    }
+}
+
+static void refresh_band(void *ctx, size_t row_start, size_t row_end)
+{
+    struct gterm_t *gterm = ctx;
+
+    for (size_t y = row_start; y < row_end; y++)
+    {
+        for (size_t x = 0; x < gterm->cols; x++)
+        {
+            struct gterm_char *c = &gterm->grid[y * gterm->cols + x];
+            if (c->c == INVALID_CHAR)
+                continue;
+
+            plot_char(gterm, c, x, y);
+        }
+    }
+}
+
+static void draw_viewport_row(struct gterm_t *gterm, size_t row)
+{
+    size_t line = gterm->sb_count + row - gterm->sb_offset;
+    if (line >= gterm->sb_count)
+    {
+        for (size_t x = 0; x < gterm->cols; x++)
+            plot_char(gterm, logical_char(gterm, (line - gterm->sb_count) * gterm->cols + x), x, row);
+        return;
+    }
+
+    size_t pos = gterm->sb_lines[(gterm->sb_first + line) % gterm->sb_lines_size];
+    uint16_t len, runs;
+    sb_get(gterm, &pos, &len, 2);
+    sb_get(gterm, &pos, &runs, 2);
+
+    size_t glyph_bytes = (len & SB_WIDE_GLYPHS) ? 3 : 1;
+    len &= ~SB_WIDE_GLYPHS;
+
+    size_t glyph_pos = pos + runs * SB_RUN_SIZE;
+    struct gterm_char c;
+    uint16_t run_left = 0;
+    uint8_t attributes = 0;
+    for (size_t x = 0; x < gterm->cols; x++)
+    {
+        if (x >= len)
+        {
+            c.c = gterm->cp437_glyphs[' '];
+            c.fg = gterm->default_fg;
+            c.bg = 0xFFFFFFFF;
+        }
+        else
+        {
+            while (run_left == 0 && runs-- != 0)
+            {
+                sb_get(gterm, &pos, &run_left, 2);
+                sb_get(gterm, &pos, &c.fg, 4);
+                sb_get(gterm, &pos, &c.bg, 4);
+                sb_get(gterm, &pos, &attributes, 1);
+            }
+            run_left--;
+
+            uint32_t glyph = 0;
+            sb_get(gterm, &glyph_pos, &glyph, glyph_bytes);
+            c.c = glyph | (uint32_t)attributes << 24;
+        }
+
+        plot_char(gterm, &c, x, row);
+    }
+}
+
+static void viewport_band(void *ctx, size_t row_start, size_t row_end)
+{
+    struct gterm_t *gterm = ctx;
+
+    for (size_t row = row_start; row < row_end; row++)
+        draw_viewport_row(gterm, row);
+}
+
+void gterm_context_restore(struct gterm_t *gterm, uint64_t ptr)
+{
+    memcpy(&gterm->context, (void*)ptr, sizeof(struct gterm_context));
+    ptr += sizeof(struct gterm_context);
+
+    memcpy(gterm->grid, (void*)ptr, gterm->grid_size);
+    gterm->moves_i = 0;
+    gterm->sb_offset = 0;
+    retint(gterm, NULL);
+
+    term_parallel_for(gterm->term, 0, gterm->rows, refresh_band, gterm);
+
+    gterm->cursor_drawn = false;
+    if (cursor_shown(gterm))
+        draw_cursor(gterm);
+    else
+    {
+        gterm->old_cursor_x = gterm->context.cursor_x;
+        gterm->old_cursor_y = gterm->context.cursor_y;
+    }
+}
+
+// The canvas only depends on what gterm_init() was given, a refresh copies it back
+// instead of generating it again
+static void copy_canvas_band(void *ctx, size_t band_start, size_t band_end)
+{
+    struct gterm_t *gterm = ctx;
+
+    for (size_t y = band_start; y < band_end; y++)
+    {
+        volatile uint32_t *fb_line = gterm->framebuffer_addr + y * (gterm->framebuffer.pitch / 4);
+        uint32_t *canvas_line = gterm->bg_canvas + y * gterm->framebuffer.width;
+        for (size_t x = 0; x < gterm->framebuffer.width; x++)
+            fb_line[x] = canvas_line[x];
+    }
+}
+
+void gterm_draw_background(struct gterm_t *gterm)
+{
+    term_parallel_for(gterm->term, 0, gterm->framebuffer.height, copy_canvas_band, gterm);
+}
+
+void gterm_full_refresh(struct gterm_t *gterm)
+{
+    gterm_draw_background(gterm);
+    gterm->moves_i = 0;
+
+    if (gterm->sb_offset != 0)
+    {
+        term_parallel_for(gterm->term, 0, gterm->rows, viewport_band, gterm);
+        return;
+    }
+
+    term_parallel_for(gterm->term, 0, gterm->rows, refresh_band, gterm);
+
+    gterm->cursor_drawn = false;
+    if (cursor_shown(gterm))
+        draw_cursor(gterm);
+    else
+    {
+        gterm->old_cursor_x = gterm->context.cursor_x;
+        gterm->old_cursor_y = gterm->context.cursor_y;
+    }
+}
+
+static void apply_palette(struct gterm_t *gterm, const bool *changed)
+{
+    size_t used = 0;
+    for (size_t i = 0; i < 256; i++)
+        if (changed[i])
+            used += gterm->palette_usage[i];
+
+    if (used == 0)
+        return;
+
+    // History on the viewport is not tracked, it is drawn again as a whole
+    if (gterm->sb_offset != 0)
+    {
+        retint(gterm, NULL);
+        gterm_full_refresh(gterm);
+        return;
+    }
+
+    retint(gterm, changed);
+}
+
+void gterm_set_palette(struct gterm_t *gterm, size_t index, uint32_t rgb)
+{
+    if (index >= 256 || gterm->palette[index] == (rgb & 0xFFFFFF))
+        return;
+
+    bool changed[256] = { false };
+    changed[index] = true;
+    gterm->palette[index] = rgb & 0xFFFFFF;
+
+    apply_palette(gterm, changed);
+}
+
+void gterm_reset_palette(struct gterm_t *gterm)
+{
+    uint32_t old[256];
+    memcpy(old, gterm->palette, sizeof(old));
+    load_palette(gterm);
+
+    bool changed[256];
+    for (size_t i = 0; i < 256; i++)
+        changed[i] = old[i] != gterm->palette[i];
+
+    apply_palette(gterm, changed);
+}
+
+// The screens are exchanged cell by cell rather than by pointer since the grid has to keep
+// describing the framebuffer, only the cells that differ from it are queued
+bool gterm_swap_screen(struct gterm_t *gterm)
+{
+    if (gterm->alt_grid == NULL)
+    {
+        gterm->alt_grid = alloc_mem(gterm->grid_size);
+        if (gterm->alt_grid == NULL)
+            return false;
+
+        for (size_t i = 0; i < gterm->rows * gterm->cols; i++)
+        {
+            gterm->alt_grid[i].c = gterm->cp437_glyphs[' '];
+            gterm->alt_grid[i].fg = gterm->default_fg;
+            gterm->alt_grid[i].bg = 0xFFFFFFFF;
+        }
+    }
+
+    for (size_t i = 0; i < gterm->rows * gterm->cols; i++)
+    {
+        struct gterm_char c = gterm->alt_grid[i];
+        gterm->alt_grid[i] = *logical_char(gterm, i);
+        push_to_queue(gterm, &c, i % gterm->cols, i / gterm->cols);
+    }
+
+    return true;
+}
+
+// Keeps about lines rows of history, a line takes its width in bytes plus one run of
+// attributes, lines with many attribute changes shorten the history
+bool gterm_set_scrollback(struct gterm_t *gterm, size_t lines)
+{
+    if (gterm->sb_data != NULL)
+    {
+        free_mem(gterm->sb_data, gterm->sb_data_size);
+        free_mem(gterm->sb_lines, gterm->sb_lines_size * sizeof(size_t));
+    }
+
+    if (gterm->sb_offset != 0)
+    {
+        gterm->sb_offset = 0;
+        gterm_full_refresh(gterm);
+    }
+
+    gterm->sb_data = NULL;
+    gterm->sb_data_size = 0;
+    gterm->sb_lines = NULL;
+    gterm->sb_lines_size = 0;
+    gterm->sb_head = gterm->sb_tail = 0;
+    gterm->sb_first = gterm->sb_count = 0;
+
+    if (lines == 0)
+        return true;
+
+    gterm->sb_data_size = lines * (4 + SB_RUN_SIZE + gterm->cols);
+    gterm->sb_data = alloc_mem(gterm->sb_data_size);
+    gterm->sb_lines = alloc_mem(lines * sizeof(size_t));
+    if (gterm->sb_data == NULL || gterm->sb_lines == NULL)
+    {
+        if (gterm->sb_data != NULL)
+            free_mem(gterm->sb_data, gterm->sb_data_size);
+        if (gterm->sb_lines != NULL)
+            free_mem(gterm->sb_lines, lines * sizeof(size_t));
+        gterm->sb_data = NULL;
+        gterm->sb_data_size = 0;
+        gterm->sb_lines = NULL;
+        return false;
+    }
+
+    gterm->sb_lines_size = lines;
+    return true;
+}
+
+// Positive counts page back into history, negative ones towards live output. Rows that stay
+// visible are moved on the framebuffer, only the exposed ones are drawn.
+void gterm_scroll_viewport(struct gterm_t *gterm, int64_t lines)
+{
+    if (gterm->sb_data == NULL)
+        return;
+
+    size_t old = gterm->sb_offset;
+    size_t new;
+    if (lines >= 0)
+        new = (uint64_t)lines >= gterm->sb_count - old ? gterm->sb_count : old + lines;
+    else
+    {
+        uint64_t back = lines == INT64_MIN ? UINT64_MAX : (uint64_t)(-lines);
+        new = back >= old ? 0 : old - back;
+    }
+
+    if (new == old)
+        return;
+
+    if (old == 0)
+    {
+        // Bring the screen up to date and take the cursor off it before moving it around
+        gterm_double_buffer_flush(gterm);
+        erase_cursor(gterm);
+    }
+
+    gterm->sb_offset = new;
+
+    if (new == 0)
+    {
+        gterm_full_refresh(gterm);
+        return;
+    }
+
+    size_t delta = new > old ? new - old : old - new;
+    if (delta >= gterm->rows)
+    {
+        term_parallel_for(gterm->term, 0, gterm->rows, viewport_band, gterm);
+        return;
+    }
+
+    struct gterm_move m = { 0, 0, gterm->cols, gterm->rows - delta, 0, 0 };
+    if (new > old)
+    {
+        m.new_y = delta;
+        move_pixels(gterm, &m, m.height);
+        term_parallel_for(gterm->term, 0, delta, viewport_band, gterm);
+    }
+    else
+    {
+        m.y = delta;
+        move_pixels(gterm, &m, m.height);
+        term_parallel_for(gterm->term, gterm->rows - delta, gterm->rows, viewport_band, gterm);
+    }
+}
+
+static void panic_plot(struct gterm_t *gterm, uint8_t c)
+{
+    struct gterm_char ch;
+    ch.c = gterm->cp437_glyphs[c];
+    ch.fg = gterm->default_fg;
+    ch.bg = 0xFFFFFFFF;
+    plot_char(gterm, &ch, gterm->panic_x, gterm->panic_y);
+}
+
+static void panic_newline(struct gterm_t *gterm)
+{
+    gterm->panic_x = 0;
+    if (++gterm->panic_y < gterm->rows)
+        return;
+
+    gterm->panic_y = gterm->rows - 1;
+    if (gterm->rows > 1)
+    {
+        struct gterm_move m = { 0, 1, gterm->cols, gterm->rows - 1, 0, 0 };
+        move_pixels(gterm, &m, m.height);
+    }
+
+    for (size_t x = 0; x < gterm->cols; x++)
+    {
+        gterm->panic_x = x;
+        panic_plot(gterm, ' ');
+    }
+    gterm->panic_x = 0;
+}
+
+// The queue, the grid and the cursor may be in the middle of an update on another CPU.
+// None of them are used from here on, panic output keeps its own position and only
+// reads the font and the canvas, which never change after init.
+void gterm_panic(struct gterm_t *gterm)
+{
+    gterm->panic_x = 0;
+    gterm->panic_y = gterm->context.cursor_y;
+    if (gterm->panic_y >= gterm->rows)
+        gterm->panic_y = gterm->rows - 1;
+
+    panic_newline(gterm);
+}
+
+void gterm_panic_write(struct gterm_t *gterm, const char *buf, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        uint8_t c = buf[i];
+        switch (c)
+        {
+            case '\n':
+                panic_newline(gterm);
+                continue;
+            case '\r':
+                gterm->panic_x = 0;
+                continue;
+            case '\t':
+                c = ' ';
+                break;
+        }
+
+        if (gterm->panic_x >= gterm->cols)
+            panic_newline(gterm);
+
+        panic_plot(gterm, c);
+        gterm->panic_x++;
+    }
+}
+
+// Reports the grid with pending changes applied. It may run on another CPU while the
+// writer modifies the grid, term_read_snapshot() discards the copy if it did. Flushing
+// cells leaves them readable, only moving queue items around is fenced off.
+void gterm_snapshot(struct gterm_t *gterm, struct term_snapshot *snap)
+{
+    for (size_t i = 0; i < gterm->rows * gterm->cols; i++)
+    {
+        struct gterm_char c;
+        struct gterm_queue_item *q = __atomic_load_n(&gterm->map[i], __ATOMIC_ACQUIRE);
+        if (q != NULL)
+            c = q->c;
+        else
+            c = gterm->grid[i];
+
+        snap->cells[i].c = c.c;
+        snap->cells[i].fg = resolve_colour(gterm, c.fg);
+        snap->cells[i].bg = resolve_colour(gterm, c.bg);
+    }
+
+    snap->cursor_x = gterm->context.cursor_x;
+    snap->cursor_y = gterm->context.cursor_y;
+    snap->cursor_visible = cursor_shown(gterm);
+}
+
+// Brings the grid up to date without drawing anything, for when the framebuffer is
+// owned by a separate renderer
+void gterm_logical_flush(struct gterm_t *gterm)
+{
+    term_seq_begin(gterm->term);
+
+    for (size_t i = 0; i < gterm->queue_i; i++)
+    {
+        struct gterm_queue_item *q = &gterm->queue[i];
+        size_t offset = q->y * gterm->cols + q->x;
+        if (gterm->map[offset] == NULL)
+            continue;
+
+        gterm->grid[offset] = q->c;
+        gterm->map[offset] = NULL;
+        count_colours(gterm, &q->c);
+    }
+
+    gterm->queue_i = 0;
+    gterm->moves_i = 0;
+
+    term_seq_end(gterm->term);
+}
+
+void gterm_draw_cell(struct gterm_t *gterm, size_t x, size_t y, const struct term_cell *c)
+{
+    struct gterm_char ch;
+    ch.c = c->c;
+    ch.fg = c->fg;
+    ch.bg = c->bg;
+    plot_char(gterm, &ch, x, y);
+}
+
+static void ops_deinit(void *gterm)
+{
+    gterm_deinit(gterm);
+}
+
+static void ops_putchar(void *gterm, uint8_t c)
+{
+    gterm_putchar(gterm, c);
+}
+
+static void ops_repeat_char(void *gterm, uint8_t c, size_t count)
+{
+    gterm_repeat_char(gterm, c, count);
+}
+
+static bool ops_put_code_point(void *gterm, uint32_t code_point)
+{
+    return gterm_put_code_point(gterm, code_point);
+}
+
+static void ops_set_cursor_shape(void *gterm, size_t shape, bool blink)
+{
+    gterm_set_cursor_shape(gterm, shape, blink);
+}
+
+static bool ops_cursor_tick(void *gterm)
+{
+    return gterm_cursor_tick(gterm);
+}
+
+static void ops_clear(void *gterm, bool move)
+{
+    gterm_clear(gterm, move);
+}
+
+static void ops_enable_cursor(void *gterm)
+{
+    gterm_enable_cursor(gterm);
+}
+
+static bool ops_disable_cursor(void *gterm)
+{
+    return gterm_disable_cursor(gterm);
+}
+
+static void ops_set_cursor_pos(void *gterm, size_t x, size_t y)
+{
+    gterm_set_cursor_pos(gterm, x, y);
+}
+
+static void ops_get_cursor_pos(void *gterm, size_t *x, size_t *y)
+{
+    gterm_get_cursor_pos(gterm, x, y);
+}
+
+static void ops_set_text_fg(void *gterm, size_t fg)
+{
+    gterm_set_text_fg(gterm, fg);
+}
+
+static void ops_set_text_bg(void *gterm, size_t bg)
+{
+    gterm_set_text_bg(gterm, bg);
+}
+
+static void ops_set_text_fg_bright(void *gterm, size_t fg)
+{
+    gterm_set_text_fg_bright(gterm, fg);
+}
+
+static void ops_set_text_bg_bright(void *gterm, size_t bg)
+{
+    gterm_set_text_bg_bright(gterm, bg);
+}
+
+static void ops_set_text_fg_rgb(void *gterm, uint32_t fg)
+{
+    gterm_set_text_fg_rgb(gterm, fg);
+}
+
+static void ops_set_text_bg_rgb(void *gterm, uint32_t bg)
+{
+    gterm_set_text_bg_rgb(gterm, bg);
+}
+
+static void ops_set_text_attributes(void *gterm, uint32_t attributes)
+{
+    gterm_set_text_attributes(gterm, attributes);
+}
+
+static void ops_set_text_fg_default(void *gterm)
+{
+    gterm_set_text_fg_default(gterm);
+}
+
+static void ops_set_text_bg_default(void *gterm)
+{
+    gterm_set_text_bg_default(gterm);
+}
+
+static bool ops_scroll_disable(void *gterm)
+{
+    return gterm_scroll_disable(gterm);
+}
+
+static void ops_scroll_enable(void *gterm)
+{
+    gterm_scroll_enable(gterm);
+}
+
+static void ops_move_character(void *gterm, size_t new_x, size_t new_y, size_t old_x, size_t old_y)
+{
+    gterm_move_character(gterm, new_x, new_y, old_x, old_y);
+}
+
+static void ops_insert_chars(void *gterm, size_t x, size_t y, size_t count)
+{
+    gterm_insert_chars(gterm, x, y, count);
+}
+
+static void ops_delete_chars(void *gterm, size_t x, size_t y, size_t count)
+{
+    gterm_delete_chars(gterm, x, y, count);
+}
+
+static void ops_insert_lines(void *gterm, size_t y, size_t count)
+{
+    gterm_insert_lines(gterm, y, count);
+}
+
+static void ops_delete_lines(void *gterm, size_t y, size_t count)
+{
+    gterm_delete_lines(gterm, y, count);
+}
+
+static void ops_scroll(void *gterm)
+{
+    gterm_scroll(gterm);
+}
+
+static void ops_revscroll(void *gterm)
+{
+    gterm_revscroll(gterm);
+}
+
+static void ops_swap_palette(void *gterm)
+{
+    gterm_swap_palette(gterm);
+}
+
+static void ops_save_state(void *gterm)
+{
+    gterm_save_state(gterm);
+}
+
+static void ops_restore_state(void *gterm)
+{
+    gterm_restore_state(gterm);
+}
+
+static void ops_double_buffer_flush(void *gterm)
+{
+    gterm_double_buffer_flush(gterm);
+}
+
+static bool ops_flush_budget(void *gterm, size_t max_cells, uint64_t max_time)
+{
+    return gterm_flush_budget(gterm, max_cells, max_time);
+}
+
+static uint64_t ops_context_size(void *gterm)
+{
+    return gterm_context_size(gterm);
+}
+
+static void ops_context_save(void *gterm, uint64_t ptr)
+{
+    gterm_context_save(gterm, ptr);
+}
+
+static void ops_context_restore(void *gterm, uint64_t ptr)
+{
+    gterm_context_restore(gterm, ptr);
+}
+
+static void ops_full_refresh(void *gterm)
+{
+    gterm_full_refresh(gterm);
+}
+
+static void ops_panic(void *gterm)
+{
+    gterm_panic(gterm);
+}
+
+static void ops_panic_write(void *gterm, const char *buf, size_t count)
+{
+    gterm_panic_write(gterm, buf, count);
+}
+
+static void ops_snapshot(void *gterm, struct term_snapshot *snap)
+{
+    gterm_snapshot(gterm, snap);
+}
+
+static void ops_logical_flush(void *gterm)
+{
+    gterm_logical_flush(gterm);
+}
+
+static void ops_draw_cell(void *gterm, size_t x, size_t y, const struct term_cell *c)
+{
+    gterm_draw_cell(gterm, x, y, c);
+}
+
+static void ops_draw_background(void *gterm)
+{
+    gterm_draw_background(gterm);
+}
+
+static void ops_set_text_fg_indexed(void *gterm, size_t fg)
+{
+    gterm_set_text_fg_indexed(gterm, fg);
+}
+
+static void ops_set_text_bg_indexed(void *gterm, size_t bg)
+{
+    gterm_set_text_bg_indexed(gterm, bg);
+}
+
+static void ops_set_palette(void *gterm, size_t index, uint32_t rgb)
+{
+    gterm_set_palette(gterm, index, rgb);
+}
+
+static void ops_reset_palette(void *gterm)
+{
+    gterm_reset_palette(gterm);
+}
+
+static bool ops_swap_screen(void *gterm)
+{
+    return gterm_swap_screen(gterm);
+}
+
+static bool ops_set_scrollback(void *gterm, size_t lines)
+{
+    return gterm_set_scrollback(gterm, lines);
+}
+
+static void ops_scroll_viewport(void *gterm, int64_t lines)
+{
+    gterm_scroll_viewport(gterm, lines);
+}
+
+const struct term_backend_ops gterm_backend_ops = {
+    .deinit = ops_deinit,
+    .putchar = ops_putchar,
+    .repeat_char = ops_repeat_char,
+    .clear = ops_clear,
+    .enable_cursor = ops_enable_cursor,
+    .disable_cursor = ops_disable_cursor,
+    .set_cursor_pos = ops_set_cursor_pos,
+    .get_cursor_pos = ops_get_cursor_pos,
+    .set_text_fg = ops_set_text_fg,
+    .set_text_bg = ops_set_text_bg,
+    .set_text_fg_bright = ops_set_text_fg_bright,
+    .set_text_bg_bright = ops_set_text_bg_bright,
+    .set_text_fg_rgb = ops_set_text_fg_rgb,
+    .set_text_bg_rgb = ops_set_text_bg_rgb,
+    .set_text_fg_default = ops_set_text_fg_default,
+    .set_text_bg_default = ops_set_text_bg_default,
+    .set_text_attributes = ops_set_text_attributes,
+    .scroll_disable = ops_scroll_disable,
+    .scroll_enable = ops_scroll_enable,
+    .move_character = ops_move_character,
+    .insert_chars = ops_insert_chars,
+    .delete_chars = ops_delete_chars,
+    .insert_lines = ops_insert_lines,
+    .delete_lines = ops_delete_lines,
+    .scroll = ops_scroll,
+    .revscroll = ops_revscroll,
+    .swap_palette = ops_swap_palette,
+    .save_state = ops_save_state,
+    .restore_state = ops_restore_state,
+    .double_buffer_flush = ops_double_buffer_flush,
+    .flush_budget = ops_flush_budget,
+    .context_size = ops_context_size,
+    .context_save = ops_context_save,
+    .context_restore = ops_context_restore,
+    .full_refresh = ops_full_refresh,
+    .panic = ops_panic,
+    .panic_write = ops_panic_write,
+    .snapshot = ops_snapshot,
+    .logical_flush = ops_logical_flush,
+    .draw_cell = ops_draw_cell,
+    .draw_background = ops_draw_background,
+    .set_scrollback = ops_set_scrollback,
+    .scroll_viewport = ops_scroll_viewport,
+    .swap_screen = ops_swap_screen,
+    .set_text_fg_indexed = ops_set_text_fg_indexed,
+    .set_text_bg_indexed = ops_set_text_bg_indexed,
+    .set_palette = ops_set_palette,
+    .reset_palette = ops_reset_palette,
+    .put_code_point = ops_put_code_point,
+    .set_cursor_shape = ops_set_cursor_shape,
+    .cursor_tick = ops_cursor_tick
+};
\ No newline at end of file
@@ -20,10 +20,70 @@ struct gterm_queue_item
     struct gterm_char c;
 };
 
+#define MAX_PENDING_MOVES 16
+
+#define GLYPH_ATLAS_PAGE 64
+#define GLYPH_ATLAS_PAGES 64
+#define GLYPH_ATLAS_HASH (GLYPH_ATLAS_PAGE * GLYPH_ATLAS_PAGES * 2)
+
+#define BLEND_TABLES 256
+#define BLEND_HASH (BLEND_TABLES * 2)
+
+// The expanded glyphs of a font: masks of the first glyphs, the atlas and the blend tables.
+// Terminals set up with term_vbe_attach() share them, the last one to let go frees them.
+struct gterm_glyphs
+{
+    size_t users;
+    size_t glyph_size;
+    size_t levels;
+
+    size_t masks_size;
+    uint8_t *masks;
+
+    uint8_t *atlas_pages[GLYPH_ATLAS_PAGES];
+    uint32_t *atlas_keys;
+    uint32_t *atlas_hash;
+    size_t atlas_used;
+
+    uint32_t *blend_tables;
+    uint64_t *blend_keys;
+    uint32_t *blend_hash;
+    size_t blend_used;
+};
+
+// The background behind the text, shared in the same way by terminals on framebuffers of the
+// same size
+struct gterm_canvas
+{
+    size_t users;
+    size_t size;
+    uint32_t *pixels;
+};
+
+// What a terminal set up with term_vbe_attach() takes over from its source. Holding one keeps
+// the resources alive while the source itself is set up again.
+struct gterm_share
+{
+    struct gterm_glyphs *glyphs;
+    struct gterm_canvas *canvas;
+    struct font_t font;
+    struct style_t style;
+    struct background_t back;
+    uint64_t width, height;
+};
+
+struct gterm_move
+{
+    size_t x, y;
+    size_t width, height;
+    size_t new_x, new_y;
+};
+
 struct gterm_context
 {
     uint32_t text_fg;
     uint32_t text_bg;
+    uint32_t text_attributes;
     bool cursor_status;
     size_t cursor_x;
     size_t cursor_y;
@@ -44,7 +104,6 @@ struct gterm_t
 
     size_t font_width;
     size_t font_height;
-    size_t font_bytes;
     size_t glyph_width;
     size_t glyph_height;
 
@@ -53,19 +112,39 @@ struct gterm_t
 
     size_t offset_x, offset_y;
 
-    uint8_t *font_bits;
-    size_t font_bool_size;
-    bool *font_bool;
+    const uint8_t *font_bits;
+    bool (*font_render)(void *renderer, uint32_t glyph, uint8_t *coverage, size_t stride);
+    void *font_renderer;
+    size_t font_bits_width;
+    size_t font_row_bytes;
+    size_t font_bpp;
+    uint8_t coverage_max;
+    uint32_t font_glyphs;
+    size_t font_mask_glyphs;
+
+    const struct font_map_t *font_map;
+    size_t font_map_size;
+    uint32_t cp437_glyphs[FONT_GLYPHS];
+
+    struct gterm_glyphs *glyphs;
 
     uint32_t ansi_colours[8];
     uint32_t ansi_bright_colours[8];
     uint32_t default_fg, default_bg;
 
+    uint32_t palette[256];
+    size_t palette_usage[256];
+
     struct image_t *background;
 
-    size_t bg_canvas_size;
+    struct gterm_canvas *canvas;
     uint32_t *bg_canvas;
 
+    // What the terminal was set up with, for terminals attaching to it
+    struct font_t font;
+    struct style_t style;
+    struct background_t back;
+
     size_t rows;
     size_t cols;
     size_t margin;
@@ -82,10 +161,36 @@ struct gterm_t
 
     struct gterm_queue_item **map;
 
+    struct gterm_move moves[MAX_PENDING_MOVES];
+    size_t moves_i;
+
+    uint32_t *row_hashes;
+    struct gterm_move *row_moves;
+
     struct gterm_context context;
 
     size_t old_cursor_x;
     size_t old_cursor_y;
+
+    // The cursor is an overlay drawn at old_cursor_x/y if cursor_drawn is set
+    size_t cursor_shape;
+    bool cursor_blink;
+    bool cursor_blink_on;
+    bool cursor_drawn;
+    size_t cursor_drawn_shape;
+
+    size_t panic_x;
+    size_t panic_y;
+
+    uint8_t *sb_data;
+    size_t sb_data_size;
+    size_t sb_head, sb_tail;
+    size_t *sb_lines;
+    size_t sb_lines_size;
+    size_t sb_first, sb_count;
+    size_t sb_offset;
+
+    struct gterm_char *alt_grid;
 };
 
 void gterm_save_state(struct gterm_t *gterm);
@@ -98,27 +203,55 @@ void gterm_scroll(struct gterm_t *gterm);
 void gterm_clear(struct gterm_t *gterm, bool move);
 void gterm_enable_cursor(struct gterm_t *gterm);
 bool gterm_disable_cursor(struct gterm_t *gterm);
+void gterm_set_cursor_shape(struct gterm_t *gterm, size_t shape, bool blink);
+bool gterm_cursor_tick(struct gterm_t *gterm);
 void gterm_set_cursor_pos(struct gterm_t *gterm, size_t x, size_t y);
 void gterm_get_cursor_pos(struct gterm_t *gterm, size_t *x, size_t *y);
 void gterm_move_character(struct gterm_t *gterm, size_t new_x, size_t new_y, size_t old_x, size_t old_y);
+void gterm_insert_chars(struct gterm_t *gterm, size_t x, size_t y, size_t count);
+void gterm_delete_chars(struct gterm_t *gterm, size_t x, size_t y, size_t count);
+void gterm_insert_lines(struct gterm_t *gterm, size_t y, size_t count);
+void gterm_delete_lines(struct gterm_t *gterm, size_t y, size_t count);
 void gterm_set_text_fg(struct gterm_t *gterm, size_t fg);
 void gterm_set_text_bg(struct gterm_t *gterm, size_t bg);
 void gterm_set_text_fg_bright(struct gterm_t *gterm, size_t fg);
 void gterm_set_text_bg_bright(struct gterm_t *gterm, size_t bg);
 void gterm_set_text_fg_rgb(struct gterm_t *gterm, uint32_t fg);
 void gterm_set_text_bg_rgb(struct gterm_t *gterm, uint32_t bg);
+void gterm_set_text_fg_indexed(struct gterm_t *gterm, size_t fg);
+void gterm_set_text_bg_indexed(struct gterm_t *gterm, size_t bg);
+void gterm_set_text_attributes(struct gterm_t *gterm, uint32_t attributes);
 void gterm_set_text_fg_default(struct gterm_t *gterm);
 void gterm_set_text_bg_default(struct gterm_t *gterm);
 void gterm_double_buffer_flush(struct gterm_t *gterm);
+bool gterm_flush_budget(struct gterm_t *gterm, size_t max_cells, uint64_t max_time);
 void gterm_putchar(struct gterm_t *gterm, uint8_t c);
+void gterm_repeat_char(struct gterm_t *gterm, uint8_t c, size_t count);
+bool gterm_put_code_point(struct gterm_t *gterm, uint32_t code_point);
 
 bool gterm_init(struct gterm_t *gterm, struct term_t *term, struct framebuffer_t frm, struct font_t font, struct style_t style, struct background_t back);
+bool gterm_attach(struct gterm_t *gterm, struct term_t *term, struct framebuffer_t frm, const struct gterm_share *share);
+void gterm_share(struct gterm_t *gterm, struct gterm_share *share);
+void gterm_unshare(struct gterm_share *share);
 void gterm_deinit(struct gterm_t *gterm);
 
 uint64_t gterm_context_size(struct gterm_t *gterm);
 void gterm_context_save(struct gterm_t *gterm, uint64_t ptr);
 void gterm_context_restore(struct gterm_t *gterm, uint64_t ptr);
+void gterm_draw_background(struct gterm_t *gterm);
 void gterm_full_refresh(struct gterm_t *gterm);
+void gterm_set_palette(struct gterm_t *gterm, size_t index, uint32_t rgb);
+void gterm_reset_palette(struct gterm_t *gterm);
+bool gterm_swap_screen(struct gterm_t *gterm);
+bool gterm_set_scrollback(struct gterm_t *gterm, size_t lines);
+void gterm_scroll_viewport(struct gterm_t *gterm, int64_t lines);
+void gterm_panic(struct gterm_t *gterm);
+void gterm_panic_write(struct gterm_t *gterm, const char *buf, size_t count);
+void gterm_snapshot(struct gterm_t *gterm, struct term_snapshot *snap);
+void gterm_logical_flush(struct gterm_t *gterm);
+void gterm_draw_cell(struct gterm_t *gterm, size_t x, size_t y, const struct term_cell *c);
+
+extern const struct term_backend_ops gterm_backend_ops;
 
 #ifdef __cplusplus
 }
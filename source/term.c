@@ -2,37 +2,185 @@
 #include "gterm.h"
 #include "term.h"
 
-static const uint32_t col256[] = {
-    0x000000, 0x00005f, 0x000087, 0x0000af, 0x0000d7, 0x0000ff, 0x005f00, 0x005f5f,
-    0x005f87, 0x005faf, 0x005fd7, 0x005fff, 0x008700, 0x00875f, 0x008787, 0x0087af,
-    0x0087d7, 0x0087ff, 0x00af00, 0x00af5f, 0x00af87, 0x00afaf, 0x00afd7, 0x00afff,
-    0x00d700, 0x00d75f, 0x00d787, 0x00d7af, 0x00d7d7, 0x00d7ff, 0x00ff00, 0x00ff5f,
-    0x00ff87, 0x00ffaf, 0x00ffd7, 0x00ffff, 0x5f0000, 0x5f005f, 0x5f0087, 0x5f00af,
-    0x5f00d7, 0x5f00ff, 0x5f5f00, 0x5f5f5f, 0x5f5f87, 0x5f5faf, 0x5f5fd7, 0x5f5fff,
-    0x5f8700, 0x5f875f, 0x5f8787, 0x5f87af, 0x5f87d7, 0x5f87ff, 0x5faf00, 0x5faf5f,
-    0x5faf87, 0x5fafaf, 0x5fafd7, 0x5fafff, 0x5fd700, 0x5fd75f, 0x5fd787, 0x5fd7af,
-    0x5fd7d7, 0x5fd7ff, 0x5fff00, 0x5fff5f, 0x5fff87, 0x5fffaf, 0x5fffd7, 0x5fffff,
-    0x870000, 0x87005f, 0x870087, 0x8700af, 0x8700d7, 0x8700ff, 0x875f00, 0x875f5f,
-    0x875f87, 0x875faf, 0x875fd7, 0x875fff, 0x878700, 0x87875f, 0x878787, 0x8787af,
-    0x8787d7, 0x8787ff, 0x87af00, 0x87af5f, 0x87af87, 0x87afaf, 0x87afd7, 0x87afff,
-    0x87d700, 0x87d75f, 0x87d787, 0x87d7af, 0x87d7d7, 0x87d7ff, 0x87ff00, 0x87ff5f,
-    0x87ff87, 0x87ffaf, 0x87ffd7, 0x87ffff, 0xaf0000, 0xaf005f, 0xaf0087, 0xaf00af,
-    0xaf00d7, 0xaf00ff, 0xaf5f00, 0xaf5f5f, 0xaf5f87, 0xaf5faf, 0xaf5fd7, 0xaf5fff,
-    0xaf8700, 0xaf875f, 0xaf8787, 0xaf87af, 0xaf87d7, 0xaf87ff, 0xafaf00, 0xafaf5f,
-    0xafaf87, 0xafafaf, 0xafafd7, 0xafafff, 0xafd700, 0xafd75f, 0xafd787, 0xafd7af,
-    0xafd7d7, 0xafd7ff, 0xafff00, 0xafff5f, 0xafff87, 0xafffaf, 0xafffd7, 0xafffff,
-    0xd70000, 0xd7005f, 0xd70087, 0xd700af, 0xd700d7, 0xd700ff, 0xd75f00, 0xd75f5f,
-    0xd75f87, 0xd75faf, 0xd75fd7, 0xd75fff, 0xd78700, 0xd7875f, 0xd78787, 0xd787af,
-    0xd787d7, 0xd787ff, 0xd7af00, 0xd7af5f, 0xd7af87, 0xd7afaf, 0xd7afd7, 0xd7afff,
-    0xd7d700, 0xd7d75f, 0xd7d787, 0xd7d7af, 0xd7d7d7, 0xd7d7ff, 0xd7ff00, 0xd7ff5f,
-    0xd7ff87, 0xd7ffaf, 0xd7ffd7, 0xd7ffff, 0xff0000, 0xff005f, 0xff0087, 0xff00af,
-    0xff00d7, 0xff00ff, 0xff5f00, 0xff5f5f, 0xff5f87, 0xff5faf, 0xff5fd7, 0xff5fff,
-    0xff8700, 0xff875f, 0xff8787, 0xff87af, 0xff87d7, 0xff87ff, 0xffaf00, 0xffaf5f,
-    0xffaf87, 0xffafaf, 0xffafd7, 0xffafff, 0xffd700, 0xffd75f, 0xffd787, 0xffd7af,
-    0xffd7d7, 0xffd7ff, 0xffff00, 0xffff5f, 0xffff87, 0xffffaf, 0xffffd7, 0xffffff,
-    0x080808, 0x121212, 0x1c1c1c, 0x262626, 0x303030, 0x3a3a3a, 0x444444, 0x4e4e4e,
-    0x585858, 0x626262, 0x6c6c6c, 0x767676, 0x808080, 0x8a8a8a, 0x949494, 0x9e9e9e,
-    0xa8a8a8, 0xb2b2b2, 0xbcbcbc, 0xc6c6c6, 0xd0d0d0, 0xdadada, 0xe4e4e4, 0xeeeeee
+static void notready_void(void *backend)
+{
+    (void)backend;
+}
+
+static bool notready_bool(void *backend)
+{
+    (void)backend;
+    return false;
+}
+
+static void notready_putchar(void *backend, uint8_t c)
+{
+    (void)backend; (void)c;
+}
+
+static void notready_repeat_char(void *backend, uint8_t c, size_t count)
+{
+    (void)backend; (void)c; (void)count;
+}
+
+static void notready_clear(void *backend, bool move)
+{
+    (void)backend; (void)move;
+}
+
+static void notready_colour(void *backend, size_t colour)
+{
+    (void)backend; (void)colour;
+}
+
+static void notready_rgb(void *backend, uint32_t colour)
+{
+    (void)backend; (void)colour;
+}
+
+static void notready_two(void *backend, size_t a, size_t b)
+{
+    (void)backend; (void)a; (void)b;
+}
+
+static void notready_three(void *backend, size_t a, size_t b, size_t c)
+{
+    (void)backend; (void)a; (void)b; (void)c;
+}
+
+static void notready_get_cursor_pos(void *backend, size_t *x, size_t *y)
+{
+    (void)backend;
+    *x = 0;
+    *y = 0;
+}
+
+static void notready_move_character(void *backend, size_t new_x, size_t new_y, size_t old_x, size_t old_y)
+{
+    (void)backend; (void)new_x; (void)new_y; (void)old_x; (void)old_y;
+}
+
+static bool notready_flush_budget(void *backend, size_t max_cells, uint64_t max_time)
+{
+    (void)backend; (void)max_cells; (void)max_time;
+    return true;
+}
+
+static void notready_panic_write(void *backend, const char *buf, size_t count)
+{
+    (void)backend; (void)buf; (void)count;
+}
+
+static void notready_snapshot(void *backend, struct term_snapshot *snap)
+{
+    (void)backend;
+    memset(snap->cells, 0, snap->cols * snap->rows * sizeof(struct term_cell));
+    snap->cursor_x = 0;
+    snap->cursor_y = 0;
+    snap->cursor_visible = false;
+}
+
+static void notready_draw_cell(void *backend, size_t x, size_t y, const struct term_cell *c)
+{
+    (void)backend; (void)x; (void)y; (void)c;
+}
+
+static bool notready_set_scrollback(void *backend, size_t lines)
+{
+    (void)backend;
+    return lines == 0;
+}
+
+static void notready_scroll_viewport(void *backend, int64_t lines)
+{
+    (void)backend; (void)lines;
+}
+
+static void notready_palette(void *backend, size_t index, uint32_t rgb)
+{
+    (void)backend; (void)index; (void)rgb;
+}
+
+static bool notready_swap_screen(void *backend)
+{
+    (void)backend;
+    return false;
+}
+
+static bool notready_put_code_point(void *backend, uint32_t code_point)
+{
+    (void)backend; (void)code_point;
+    return false;
+}
+
+static void notready_set_cursor_shape(void *backend, size_t shape, bool blink)
+{
+    (void)backend; (void)shape; (void)blink;
+}
+
+static uint64_t notready_context_size(void *backend)
+{
+    (void)backend;
+    return 0;
+}
+
+static void notready_context(void *backend, uint64_t ptr)
+{
+    (void)backend; (void)ptr;
+}
+
+static const struct term_backend_ops notready_backend_ops = {
+    .deinit = notready_void,
+    .putchar = notready_putchar,
+    .repeat_char = notready_repeat_char,
+    .clear = notready_clear,
+    .enable_cursor = notready_void,
+    .disable_cursor = notready_bool,
+    .set_cursor_pos = notready_two,
+    .get_cursor_pos = notready_get_cursor_pos,
+    .set_text_fg = notready_colour,
+    .set_text_bg = notready_colour,
+    .set_text_fg_bright = notready_colour,
+    .set_text_bg_bright = notready_colour,
+    .set_text_fg_rgb = notready_rgb,
+    .set_text_bg_rgb = notready_rgb,
+    .set_text_fg_default = notready_void,
+    .set_text_bg_default = notready_void,
+    .set_text_attributes = notready_rgb,
+    .scroll_disable = notready_bool,
+    .scroll_enable = notready_void,
+    .move_character = notready_move_character,
+    .insert_chars = notready_three,
+    .delete_chars = notready_three,
+    .insert_lines = notready_two,
+    .delete_lines = notready_two,
+    .scroll = notready_void,
+    .revscroll = notready_void,
+    .swap_palette = notready_void,
+    .save_state = notready_void,
+    .restore_state = notready_void,
+    .double_buffer_flush = notready_void,
+    .flush_budget = notready_flush_budget,
+    .context_size = notready_context_size,
+    .context_save = notready_context,
+    .context_restore = notready_context,
+    .full_refresh = notready_void,
+    .panic = notready_void,
+    .panic_write = notready_panic_write,
+    .snapshot = notready_snapshot,
+    .logical_flush = notready_void,
+    .draw_cell = notready_draw_cell,
+    .draw_background = notready_void,
+    .set_scrollback = notready_set_scrollback,
+    .scroll_viewport = notready_scroll_viewport,
+    .swap_screen = notready_swap_screen,
+    .set_text_fg_indexed = notready_colour,
+    .set_text_bg_indexed = notready_colour,
+    .set_palette = notready_palette,
+    .reset_palette = notready_void,
+    .put_code_point = notready_put_code_point,
+    .set_cursor_shape = notready_set_cursor_shape,
+    .cursor_tick = notready_bool
 };
 
 void term_init(struct term_t *term, callback_t callback, bool bios, size_t tabsize)
@@ -43,7 +191,13 @@ void term_init(struct term_t *term, callback_t callback, bool bios, size_t tabsi
     term->callback = callback;
     term->bios = bios;
     term->tab_size = tabsize;
+    term->panic = false;
+    term->parallel_submit = NULL;
+    term->parallel_wait = NULL;
+    term->parallel_workers = 0;
     term->term_backend = NOT_READY;
+    term->ops = &notready_backend_ops;
+    term->backend = NULL;
 
     term->gterm = alloc_mem(sizeof(struct gterm_t));
 #if defined(__i386__) || defined(__x86_64__)
@@ -59,8 +213,7 @@ void term_deinit(struct term_t *term)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_deinit(term->gterm);
+    term->ops->deinit(term->backend);
 
     term_notready(term);
 }
@@ -78,7 +231,9 @@ void term_reinit(struct term_t *term)
     term->context.bold = false;
     term->context.reverse_video = false;
     term->context.dec_private = false;
+    term->context.intermediate = 0;
     term->context.insert_mode = false;
+    term->context.last_char = 0;
     term->context.unicode_remaining = false;
     term->context.g_select = 0;
     term->context.charsets[0] = CHARSET_DEFAULT;
@@ -91,8 +246,14 @@ void term_reinit(struct term_t *term)
     term->context.current_primary = (size_t)(-1);
     term->context.scroll_top_margin = 0;
     term->context.scroll_bottom_margin = term->rows;
+    term->context.attributes = 0;
+    term->ops->set_text_attributes(term->backend, 0);
+    term->ops->set_cursor_shape(term->backend, TERM_CURSOR_BLOCK, false);
 
     term->autoflush = true;
+    term->synchronised = false;
+    term->present_pending = false;
+    term->context.alt_screen = false;
 }
 
 void term_vbe(struct term_t *term, struct framebuffer_t frm, struct font_t font, struct style_t style, struct background_t back)
@@ -100,8 +261,7 @@ void term_vbe(struct term_t *term, struct framebuffer_t frm, struct font_t font,
     if (term->initialised == false)
         return;
 
-    if (term->term_backend != VBE)
-        term_deinit(term);
+    term_deinit(term);
 
     if (!gterm_init(term->gterm, term, frm, font, style, back) && term->bios)
     {
@@ -111,6 +271,35 @@ void term_vbe(struct term_t *term, struct framebuffer_t frm, struct font_t font,
         return;
     }
 
+    term->ops = &gterm_backend_ops;
+    term->backend = term->gterm;
+
+    term_reinit(term);
+    term->term_backend = VBE;
+}
+
+// Sets term up like source, a VBE terminal, on frm. The expanded font is shared with source,
+// and so is the background canvas when frm is the same size as the framebuffer of source.
+// Shared resources are freed when the last terminal using them is deinitialised.
+void term_vbe_attach(struct term_t *term, struct framebuffer_t frm, struct term_t *source)
+{
+    if (term->initialised == false || source->term_backend != VBE)
+        return;
+
+    // Held across the deinit, term may be source itself or the last other user
+    struct gterm_share share;
+    gterm_share(source->gterm, &share);
+
+    term_deinit(term);
+
+    bool attached = gterm_attach(term->gterm, term, frm, &share);
+    gterm_unshare(&share);
+    if (!attached)
+        return;
+
+    term->ops = &gterm_backend_ops;
+    term->backend = term->gterm;
+
     term_reinit(term);
     term->term_backend = VBE;
 }
@@ -123,6 +312,10 @@ void term_textmode(struct term_t *term)
 
     term_deinit(term);
     tterm_init(term->tterm, term);
+
+    term->ops = &tterm_backend_ops;
+    term->backend = term->tterm;
+
     term_reinit(term);
 
     term->term_backend = TEXTMODE;
@@ -132,10 +325,376 @@ void term_textmode(struct term_t *term)
 void term_notready(struct term_t *term)
 {
     term->term_backend = NOT_READY;
+    term->ops = &notready_backend_ops;
+    term->backend = NULL;
     term->cols = 80;
     term->rows = 24;
 }
 
+typedef void (*term_op_t)(void);
+
+// The table is copied, entries the host left NULL do what they do on a terminal that is not ready
+void term_custom_backend(struct term_t *term, const struct term_backend_ops *ops, void *backend, size_t cols, size_t rows)
+{
+    if (term->initialised == false || ops == NULL)
+        return;
+
+    term_deinit(term);
+
+    term->custom_ops = *ops;
+    term_op_t *entries = (term_op_t*)&term->custom_ops;
+    const term_op_t *fallback = (const term_op_t*)&notready_backend_ops;
+    for (size_t i = 0; i < sizeof(struct term_backend_ops) / sizeof(term_op_t); i++)
+        if (entries[i] == NULL)
+            entries[i] = fallback[i];
+
+    term->ops = &term->custom_ops;
+    term->backend = backend;
+    term->cols = cols;
+    term->rows = rows;
+
+    term_reinit(term);
+    term->term_backend = CUSTOM;
+}
+
+void term_set_clock(struct term_t *term, clock_callback_t clock)
+{
+    term->clock = clock;
+}
+
+void term_set_sync_timeout(struct term_t *term, uint64_t timeout)
+{
+    term->sync_timeout = timeout;
+}
+
+// submit runs a job on some worker, wait returns once every submitted job has finished.
+// nworkers counts the calling CPU too, as it takes one share of the work itself.
+void term_set_parallel_hooks(struct term_t *term, parallel_submit_t submit, parallel_wait_t wait, size_t nworkers)
+{
+    term->parallel_submit = submit;
+    term->parallel_wait = wait;
+    term->parallel_workers = nworkers;
+}
+
+struct term_parallel_band
+{
+    void (*fn)(void *ctx, size_t start, size_t end);
+    void *ctx;
+    size_t start, end;
+};
+
+static void term_run_band(void *arg)
+{
+    struct term_parallel_band *band = arg;
+    band->fn(band->ctx, band->start, band->end);
+}
+
+// Splits [start, end) into one band per worker. fn must only touch state belonging to its band.
+void term_parallel_for(struct term_t *term, size_t start, size_t end, void (*fn)(void *ctx, size_t start, size_t end), void *ctx)
+{
+    size_t bands = term->parallel_workers;
+    if (bands > TERM_MAX_PARALLEL_BANDS)
+        bands = TERM_MAX_PARALLEL_BANDS;
+    if (bands > end - start)
+        bands = end - start;
+
+    if (term->parallel_submit == NULL || term->parallel_wait == NULL || bands < 2)
+    {
+        fn(ctx, start, end);
+        return;
+    }
+
+    struct term_parallel_band band[TERM_MAX_PARALLEL_BANDS];
+    for (size_t i = 0; i < bands; i++)
+    {
+        band[i].fn = fn;
+        band[i].ctx = ctx;
+        band[i].start = start + (end - start) * i / bands;
+        band[i].end = start + (end - start) * (i + 1) / bands;
+    }
+
+    for (size_t i = 1; i < bands; i++)
+        term->parallel_submit(term, term_run_band, &band[i]);
+    term_run_band(&band[0]);
+
+    term->parallel_wait(term);
+}
+
+void term_set_frame_interval(struct term_t *term, uint64_t interval)
+{
+    term->frame_interval = interval;
+}
+
+static bool term_sync_active(struct term_t *term)
+{
+    if (term->synchronised == false)
+        return false;
+
+    // The clock may have been taken away since the update began, nothing could end it then
+    if (term->clock == NULL || term->clock(term) - term->sync_start >= term->sync_timeout)
+        term->synchronised = false;
+
+    return term->synchronised;
+}
+
+#define RENDER_FRESH ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+// Split rendering uses three snapshot slots. The writer fills its back slot and swaps it
+// with the latest one, the renderer swaps a fresh latest slot with its front slot. Neither
+// side ever waits and generations the renderer did not get to are simply overwritten.
+// Call with the renderer stopped, the slots are sized for the current grid.
+bool term_set_split_render(struct term_t *term, bool enable)
+{
+    if (term->initialised == false)
+        return false;
+
+    if (term->render_buffer != NULL)
+    {
+        free_mem(term->render_buffer, term->render_buffer_size);
+        term->render_buffer = NULL;
+        term->render_buffer_size = 0;
+    }
+
+    if (term->split_render)
+    {
+        term->split_render = false;
+        // The backend's own idea of the screen went stale while the renderer drew it
+        term_full_refresh(term);
+    }
+
+    if (enable == false)
+        return true;
+
+    size_t cells = term->cols * term->rows;
+    term->render_buffer_size = 4 * cells * sizeof(struct term_cell);
+    term->render_buffer = alloc_mem(term->render_buffer_size);
+    if (term->render_buffer == NULL)
+    {
+        term->render_buffer_size = 0;
+        return false;
+    }
+
+    for (size_t i = 0; i < 3; i++)
+    {
+        term->render_slots[i].cells = term->render_buffer + i * cells;
+        term->render_slots[i].size = cells;
+    }
+    term->render_back = 0;
+    term->render_latest = 1;
+    term->render_front = 2;
+
+    // Nothing is known to be on screen, the first frame draws every cell
+    term->render_screen = term->render_buffer + 3 * cells;
+    memset(term->render_screen, 0xFF, cells * sizeof(struct term_cell));
+
+    term->split_render = true;
+    return true;
+}
+
+static void term_publish(struct term_t *term)
+{
+    term->ops->logical_flush(term->backend);
+
+    struct term_snapshot *snap = &term->render_slots[term->render_back];
+    snap->cols = term->cols;
+    snap->rows = term->rows;
+    if (snap->size < snap->cols * snap->rows)
+        return;
+
+    term->ops->snapshot(term->backend, snap);
+
+    size_t old = __atomic_exchange_n(&term->render_latest, term->render_back | RENDER_FRESH, __ATOMIC_ACQ_REL);
+    term->render_back = old & ~RENDER_FRESH;
+}
+
+// Meant to be called from the host's render thread, draws the latest published frame by
+// only touching the cells that differ from what is on screen. Returns false if there was
+// nothing new to draw.
+bool term_render(struct term_t *term)
+{
+    if (term->split_render == false || __atomic_load_n(&term->hidden, __ATOMIC_RELAXED))
+        return false;
+
+    bool reset = __atomic_exchange_n(&term->render_reset, false, __ATOMIC_ACQ_REL);
+    if (reset)
+    {
+        term->ops->draw_background(term->backend);
+        memset(term->render_screen, 0xFF, term->render_slots[0].size * sizeof(struct term_cell));
+    }
+
+    if (__atomic_load_n(&term->render_latest, __ATOMIC_ACQUIRE) & RENDER_FRESH)
+    {
+        size_t latest = __atomic_exchange_n(&term->render_latest, term->render_front, __ATOMIC_ACQ_REL);
+        term->render_front = latest & ~RENDER_FRESH;
+    }
+    else if (reset == false)
+        return false;
+
+    struct term_snapshot *snap = &term->render_slots[term->render_front];
+    size_t cursor = (size_t)-1;
+    if (snap->cursor_visible && snap->cursor_x < snap->cols && snap->cursor_y < snap->rows)
+        cursor = snap->cursor_y * snap->cols + snap->cursor_x;
+
+    for (size_t i = 0; i < snap->cols * snap->rows; i++)
+    {
+        if (__atomic_load_n(&term->panic, __ATOMIC_RELAXED))
+            return false;
+
+        struct term_cell c = snap->cells[i];
+        if (i == cursor)
+        {
+            uint32_t tmp = c.fg;
+            c.fg = c.bg;
+            c.bg = tmp;
+        }
+
+        struct term_cell *old = &term->render_screen[i];
+        if (old->c == c.c && old->fg == c.fg && old->bg == c.bg)
+            continue;
+
+        term->ops->draw_cell(term->backend, i % snap->cols, i / snap->cols, &c);
+        *old = c;
+    }
+
+    return true;
+}
+
+static void term_present_at(struct term_t *term, uint64_t now)
+{
+    term->present_pending = false;
+    term->last_present = now;
+
+    if (term->split_render && term->hidden == false)
+        term_publish(term);
+    else
+        term_double_buffer_flush(term);
+}
+
+// A hidden terminal keeps its grid up to date but draws nothing, showing it redraws the
+// final state once
+void term_set_visible(struct term_t *term, bool visible)
+{
+    if (term->initialised == false || term->hidden != visible)
+        return;
+
+    term->ops->logical_flush(term->backend);
+
+    if (visible == false)
+    {
+        __atomic_store_n(&term->hidden, true, __ATOMIC_RELAXED);
+        return;
+    }
+
+    __atomic_store_n(&term->hidden, false, __ATOMIC_RELAXED);
+
+    // Whatever the renderer drew last may have been painted over in the meantime
+    if (term->split_render)
+    {
+        __atomic_store_n(&term->render_reset, true, __ATOMIC_RELEASE);
+        term_publish(term);
+    }
+    else
+        term_full_refresh(term);
+}
+
+// Returns false if the last frame went out less than frame_interval ago
+static bool term_frame_due(struct term_t *term, uint64_t *now)
+{
+    *now = 0;
+    if (term->clock == NULL)
+        return true;
+
+    *now = term->clock(term);
+    if (term->frame_interval == 0)
+        return true;
+
+    return *now - term->last_present >= term->frame_interval;
+}
+
+void term_present(struct term_t *term)
+{
+    if (term->initialised == false || term->term_backend == NOT_READY)
+        return;
+
+    term_present_at(term, term->clock ? term->clock(term) : 0);
+}
+
+bool term_tick(struct term_t *term)
+{
+    if (term->initialised == false || term->present_pending == false || term_sync_active(term))
+        return false;
+
+    uint64_t now;
+    if (!term_frame_due(term, &now))
+        return false;
+
+    term_present_at(term, now);
+    return true;
+}
+
+static void term_queue_response(struct term_t *term, const char *buf, size_t count)
+{
+    size_t head = term->response_head;
+    size_t tail = __atomic_load_n(&term->response_tail, __ATOMIC_ACQUIRE);
+
+    // Replies are dropped whole rather than handing the host a truncated sequence
+    if (TERM_RESPONSE_BUFFER_SIZE - (head - tail) < count)
+        return;
+
+    for (size_t i = 0; i < count; i++)
+        term->response_buffer[(head + i) % TERM_RESPONSE_BUFFER_SIZE] = buf[i];
+
+    __atomic_store_n(&term->response_head, head + count, __ATOMIC_RELEASE);
+    term->response_pending = true;
+}
+
+static size_t term_format_dec(char *buf, size_t value)
+{
+    char digits[20];
+    size_t len = 0;
+
+    do
+    {
+        digits[len++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+
+    for (size_t i = 0; i < len; i++)
+        buf[i] = digits[len - 1 - i];
+
+    return len;
+}
+
+static void term_report_position(struct term_t *term, size_t x, size_t y)
+{
+    char buf[48];
+    size_t len = 0;
+
+    buf[len++] = 0x1B;
+    buf[len++] = '[';
+    len += term_format_dec(buf + len, y + 1);
+    buf[len++] = ';';
+    len += term_format_dec(buf + len, x + 1);
+    buf[len++] = 'R';
+
+    term_queue_response(term, buf, len);
+}
+
+size_t term_read_responses(struct term_t *term, char *buf, size_t count)
+{
+    size_t tail = term->response_tail;
+    size_t head = __atomic_load_n(&term->response_head, __ATOMIC_ACQUIRE);
+
+    if (count > head - tail)
+        count = head - tail;
+
+    for (size_t i = 0; i < count; i++)
+        buf[i] = term->response_buffer[(tail + i) % TERM_RESPONSE_BUFFER_SIZE];
+
+    __atomic_store_n(&term->response_tail, tail + count, __ATOMIC_RELEASE);
+    return count;
+}
+
 uint8_t term_dec_special_to_cp437(uint8_t c)
 {
     switch (c)
@@ -488,14 +1047,25 @@ void term_putchar(struct term_t *term, uint8_t c)
         if (term->context.unicode_remaining != 0)
             return;
 
+        // Fonts with a Unicode table draw the code point itself, REP repeats its closest
+        // code page 437 character
         int cc = unicode_to_cp437(term->context.code_point);
-        if (cc == -1)
+        if (mk_wcwidth(term->context.code_point) == 1 && term->ops->put_code_point(term->backend, term->context.code_point))
+            term->context.last_char = cc == -1 ? 8 : cc;
+        else if (cc == -1)
         {
             size_t replacement_width = mk_wcwidth(term->context.code_point);
-            for (size_t i = 0; i < replacement_width; i++)
-                term_raw_putchar(term, 8);
+            if (replacement_width != 0)
+            {
+                term->context.last_char = 8;
+                term->ops->repeat_char(term->backend, 8, replacement_width);
+            }
+        }
+        else
+        {
+            term->context.last_char = cc;
+            term->ops->putchar(term->backend, cc);
         }
-        else term_raw_putchar(term, cc);
         return;
     }
 
@@ -543,7 +1113,7 @@ unicode_error:
     }
 
     size_t x, y;
-    term_get_cursor_pos(term, &x, &y);
+    term->ops->get_cursor_pos(term->backend, &x, &y);
 
     switch (c)
     {
@@ -560,26 +1130,26 @@ unicode_error:
         case '\t':
             if ((x / term->tab_size + 1) >= term->cols)
             {
-                term_set_cursor_pos(term, term->cols - 1, y);
+                term->ops->set_cursor_pos(term->backend, term->cols - 1, y);
                 return;
             }
-            term_set_cursor_pos(term, (x / term->tab_size + 1) * term->tab_size, y);
+            term->ops->set_cursor_pos(term->backend, (x / term->tab_size + 1) * term->tab_size, y);
             return;
         case 0x0B:
         case 0x0C:
         case '\n':
             if (y == term->context.scroll_bottom_margin - 1)
             {
-                term_scroll(term);
-                term_set_cursor_pos(term, 0, y);
+                term->ops->scroll(term->backend);
+                term->ops->set_cursor_pos(term->backend, 0, y);
             }
-            else term_set_cursor_pos(term, 0, y + 1);
+            else term->ops->set_cursor_pos(term->backend, 0, y + 1);
             return;
         case '\b':
-            term_set_cursor_pos(term, x - 1, y);
+            term->ops->set_cursor_pos(term->backend, x - 1, y);
             return;
         case '\r':
-            term_set_cursor_pos(term, 0, y);
+            term->ops->set_cursor_pos(term->backend, 0, y);
             return;
         case '\a':
             if (term->callback)
@@ -593,38 +1163,329 @@ unicode_error:
             return;
     }
 
-    if (term->context.insert_mode == true)
+    if (term->context.insert_mode == true)
+        term->ops->insert_chars(term->backend, x, y, 1);
+
+    switch (term->context.charsets[term->context.current_charset])
+    {
+        case CHARSET_DEFAULT:
+            break;
+        case CHARSET_DEC_SPECIAL:
+            c = term_dec_special_to_cp437(c);
+            break;
+    }
+
+    term->context.last_char = c;
+    term->ops->putchar(term->backend, c);
+}
+
+static bool term_parse(struct term_t *term, const char *buf, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (__atomic_load_n(&term->panic, __ATOMIC_RELAXED))
+            return false;
+        term_putchar(term, buf[i]);
+    }
+    return true;
+}
+
+static void term_write_done(struct term_t *term)
+{
+    if (term->autoflush)
+    {
+        // Frames that are held back are presented by a later write or by term_tick()
+        term->present_pending = true;
+
+        uint64_t now;
+        if (!term_sync_active(term) && term_frame_due(term, &now))
+            term_present_at(term, now);
+    }
+
+    if (term->response_pending)
+    {
+        term->response_pending = false;
+        if (term->callback)
+            term->callback(term, TERM_CB_RESPONSE, term->response_head - term->response_tail, 0, 0);
+    }
+}
+
+// Writers make the counter odd while they modify the screen, see term_read_snapshot().
+// Flushes only hold it odd while they move pending cells around, windows do not nest.
+void term_seq_begin(struct term_t *term)
+{
+    __atomic_store_n(&term->seq, term->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void term_seq_end(struct term_t *term)
+{
+    __atomic_store_n(&term->seq, term->seq + 1, __ATOMIC_RELEASE);
+}
+
+void term_write(struct term_t *term, const char *buf, size_t count)
+{
+    if (term->initialised == false || term->term_backend == NOT_READY)
+        return;
+
+    term_seq_begin(term);
+    bool parsed = term_parse(term, buf, count);
+    term_seq_end(term);
+
+    if (parsed)
+        term_write_done(term);
+}
+
+// Cells refer to palette entries, so a change only redraws the cells using the entry
+void term_set_palette(struct term_t *term, size_t index, uint32_t rgb)
+{
+    if (term->initialised == false || term->term_backend == NOT_READY || index >= 256)
+        return;
+
+    term_seq_begin(term);
+    term->ops->set_palette(term->backend, index, rgb);
+    term_seq_end(term);
+
+    term_write_done(term);
+}
+
+void term_reset_palette(struct term_t *term)
+{
+    if (term->initialised == false || term->term_backend == NOT_READY)
+        return;
+
+    term_seq_begin(term);
+    term->ops->reset_palette(term->backend);
+    term_seq_end(term);
+
+    term_write_done(term);
+}
+
+// Called by the host at its blink rate, toggles a blinking cursor by redrawing the cursor
+// alone. Returns false if there is nothing blinking.
+bool term_cursor_tick(struct term_t *term)
+{
+    if (term->initialised == false || term->term_backend == NOT_READY)
+        return false;
+
+    term_seq_begin(term);
+    bool blinked = term->ops->cursor_tick(term->backend);
+    term_seq_end(term);
+
+    if (blinked && term->split_render && term->hidden == false)
+        term_publish(term);
+    return blinked;
+}
+
+#define RING_EMPTY 0
+#define RING_COMMITTED 1
+#define RING_PADDING 2
+
+struct term_ring_record
+{
+    uint32_t size;
+    uint32_t state;
+};
+
+#define RING_ALIGN(x) (((x) + sizeof(struct term_ring_record) - 1) & ~(sizeof(struct term_ring_record) - 1))
+
+// The buffer must be 8 byte aligned and must not be in use by producers while it is replaced
+void term_set_ring(struct term_t *term, void *buffer, size_t size)
+{
+    // Offsets are masked, so only the largest power of two that fits is used
+    while (size & (size - 1))
+        size &= size - 1;
+
+    if (buffer == NULL || size < 2 * sizeof(struct term_ring_record))
+    {
+        buffer = NULL;
+        size = 0;
+    }
+    else
+        memset(buffer, 0, size);
+
+    term->ring = buffer;
+    term->ring_size = size;
+    term->ring_reserve = 0;
+    term->ring_tail = 0;
+    term->ring_dropped = 0;
+}
+
+// Safe to call from any number of CPUs at once. The record is copied into the ring and is
+// parsed by the next term_ring_drain(). Records that do not fit are dropped whole.
+bool term_ring_write(struct term_t *term, const char *buf, size_t count)
+{
+    size_t size = term->ring_size;
+    size_t len = RING_ALIGN(sizeof(struct term_ring_record) + count);
+    if (term->ring == NULL || len > size || count > UINT32_MAX)
+        goto drop;
+
+    size_t head = __atomic_load_n(&term->ring_reserve, __ATOMIC_RELAXED);
+    size_t pad;
+    do
+    {
+        size_t tail = __atomic_load_n(&term->ring_tail, __ATOMIC_ACQUIRE);
+
+        // Records are contiguous, the space left before the end is skipped by a padding record
+        size_t offset = head & (size - 1);
+        pad = offset + len > size ? size - offset : 0;
+
+        if (head + pad + len - tail > size)
+            goto drop;
+    } while (!__atomic_compare_exchange_n(&term->ring_reserve, &head, head + pad + len, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    struct term_ring_record *r;
+    if (pad != 0)
+    {
+        r = (struct term_ring_record*)(term->ring + (head & (size - 1)));
+        r->size = pad;
+        __atomic_store_n(&r->state, RING_PADDING, __ATOMIC_RELEASE);
+        head += pad;
+    }
+
+    r = (struct term_ring_record*)(term->ring + (head & (size - 1)));
+    r->size = count;
+    memcpy(r + 1, buf, count);
+    __atomic_store_n(&r->state, RING_COMMITTED, __ATOMIC_RELEASE);
+    return true;
+
+drop:
+    __atomic_fetch_add(&term->ring_dropped, 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+// Only one CPU may drain at a time. Records are parsed in the order they were reserved,
+// a record that is reserved but not yet committed holds back the ones behind it.
+void term_ring_drain(struct term_t *term)
+{
+    if (term->initialised == false || term->term_backend == NOT_READY || term->ring == NULL)
+        return;
+
+    size_t tail = term->ring_tail;
+    bool written = false;
+
+    term_seq_begin(term);
+
+    for (;;)
     {
-        for (size_t i = term->cols - 1; ; i--)
+        struct term_ring_record *r = (struct term_ring_record*)(term->ring + (tail & (term->ring_size - 1)));
+        uint32_t state = __atomic_load_n(&r->state, __ATOMIC_ACQUIRE);
+        if (state == RING_EMPTY)
+            break;
+
+        size_t len = r->size;
+        if (state == RING_COMMITTED)
         {
-            term_move_character(term, i + 1, y, i, y);
-            if (i == x)
+            if (!term_parse(term, (const char*)(r + 1), len))
+            {
+                written = false;
                 break;
+            }
+            len = RING_ALIGN(sizeof(struct term_ring_record) + len);
+            written = true;
         }
+
+        // Free space is kept zeroed so a header slot reads as empty until it is committed
+        memset(r, 0, len);
+        tail += len;
+        __atomic_store_n(&term->ring_tail, tail, __ATOMIC_RELEASE);
     }
 
-    switch (term->context.charsets[term->context.current_charset])
+    term_seq_end(term);
+
+    if (written)
+        term_write_done(term);
+}
+
+// Copies the screen as term_write() leaves it, from any CPU and without stopping the writer.
+// The copy is retried until no write overlapped it. Returns false if the terminal is not
+// initialised or the cells buffer is too small, cols and rows are filled in either way.
+bool term_read_snapshot(struct term_t *term, struct term_snapshot *snap)
+{
+    if (term->initialised == false)
+        return false;
+
+    for (;;)
     {
-        case CHARSET_DEFAULT:
-            break;
-        case CHARSET_DEC_SPECIAL:
-            c = term_dec_special_to_cp437(c);
-            break;
+        size_t seq = __atomic_load_n(&term->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+
+        snap->cols = term->cols;
+        snap->rows = term->rows;
+        if (snap->size < snap->cols * snap->rows)
+            return false;
+
+        term->ops->snapshot(term->backend, snap);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&term->seq, __ATOMIC_RELAXED) == seq)
+            return true;
     }
+}
+
+// No locks, allocations or callbacks past this point, it may run in NMI context while
+// another CPU is stuck halfway through term_write(). Once set, regular output stops for good.
+void term_panic(struct term_t *term)
+{
+    if (term->initialised == false)
+        return;
+
+    if (__atomic_exchange_n(&term->panic, true, __ATOMIC_ACQ_REL))
+        return;
 
-    term_raw_putchar(term, c);
+    term->ops->panic(term->backend);
 }
 
-void term_write(struct term_t *term, const char *buf, size_t count)
+void term_panic_write(struct term_t *term, const char *buf, size_t count)
 {
-    if (term->initialised == false || term->term_backend == NOT_READY)
+    if (term->initialised == false)
         return;
 
-    for (size_t i = 0; i < count; i++)
-        term_putchar(term, buf[i]);
+    term_panic(term);
+    term->ops->panic_write(term->backend, buf, count);
+}
 
-    if (term->autoflush)
-        term_double_buffer_flush(term);
+bool term_set_scrollback(struct term_t *term, size_t lines)
+{
+    if (term->initialised == false)
+        return false;
+
+    return term->ops->set_scrollback(term->backend, lines);
+}
+
+// The viewport draws straight to the screen, it stays put while hidden or split rendering
+void term_scroll_viewport(struct term_t *term, int64_t lines)
+{
+    if (term->initialised == false || term->hidden || term->split_render)
+        return;
+
+    term->ops->scroll_viewport(term->backend, lines);
+}
+
+void term_viewport_reset(struct term_t *term)
+{
+    term_scroll_viewport(term, INT64_MIN);
+}
+
+static uint32_t term_sgr_attribute(uint32_t value)
+{
+    switch (value)
+    {
+        case 3:
+            return TERM_ATTR_ITALIC;
+        case 4:
+            return TERM_ATTR_UNDERLINE;
+        case 9:
+            return TERM_ATTR_STRIKE;
+    }
+    return 0;
+}
+
+// Bold is tracked apart since it also selects the bright colours
+static void term_update_attributes(struct term_t *term)
+{
+    term_set_text_attributes(term, term->context.attributes | (term->context.bold ? TERM_ATTR_BOLD : 0));
 }
 
 void term_sgr(struct term_t *term)
@@ -644,12 +1505,13 @@ def:
             if (term->context.reverse_video)
             {
                 term->context.reverse_video = false;
-                term_swap_palette(term);
+                term->ops->swap_palette(term->backend);
             }
             term->context.bold = false;
+            term->context.attributes = 0;
             term->context.current_primary = (size_t)(-1);
-            term_set_text_bg_default(term);
-            term_set_text_fg_default(term);
+            term->ops->set_text_bg_default(term->backend);
+            term->ops->set_text_fg_default(term->backend);
             continue;
         }
         else if (term->context.esc_values[i] == 1)
@@ -658,9 +1520,9 @@ def:
             if (term->context.current_primary != (size_t)(-1))
             {
                 if (!term->context.reverse_video)
-                    term_set_text_fg_bright(term, term->context.current_primary);
+                    term->ops->set_text_fg_bright(term->backend, term->context.current_primary);
                 else
-                    term_set_text_bg_bright(term, term->context.current_primary);
+                    term->ops->set_text_bg_bright(term->backend, term->context.current_primary);
             }
             continue;
         }
@@ -670,12 +1532,22 @@ def:
             if (term->context.current_primary != (size_t)(-1))
             {
                 if (!term->context.reverse_video)
-                    term_set_text_fg(term, term->context.current_primary);
+                    term->ops->set_text_fg(term->backend, term->context.current_primary);
                 else
-                    term_set_text_bg(term, term->context.current_primary);
+                    term->ops->set_text_bg(term->backend, term->context.current_primary);
             }
             continue;
         }
+        else if (term_sgr_attribute(term->context.esc_values[i]) != 0)
+        {
+            term->context.attributes |= term_sgr_attribute(term->context.esc_values[i]);
+            continue;
+        }
+        else if (term->context.esc_values[i] >= 20 && term_sgr_attribute(term->context.esc_values[i] - 20) != 0)
+        {
+            term->context.attributes &= ~term_sgr_attribute(term->context.esc_values[i] - 20);
+            continue;
+        }
         else if (term->context.esc_values[i] >= 30 && term->context.esc_values[i] <= 37)
         {
             offset = 30;
@@ -685,9 +1557,9 @@ def:
                 goto set_bg;
 set_fg:
             if (term->context.bold && !term->context.reverse_video)
-                term_set_text_fg_bright(term, term->context.esc_values[i] - offset);
+                term->ops->set_text_fg_bright(term->backend, term->context.esc_values[i] - offset);
             else
-                term_set_text_fg(term, term->context.esc_values[i] - offset);
+                term->ops->set_text_fg(term->backend, term->context.esc_values[i] - offset);
 
             continue;
         }
@@ -698,9 +1570,9 @@ set_fg:
                 goto set_fg;
 set_bg:
             if (term->context.bold && term->context.reverse_video)
-                term_set_text_bg_bright(term, term->context.esc_values[i] - offset);
+                term->ops->set_text_bg_bright(term->backend, term->context.esc_values[i] - offset);
             else
-                term_set_text_bg(term, term->context.esc_values[i] - offset);
+                term->ops->set_text_bg(term->backend, term->context.esc_values[i] - offset);
             continue;
         }
         else if (term->context.esc_values[i] >= 90 && term->context.esc_values[i] <= 97)
@@ -719,7 +1591,7 @@ set_fg_bright:
             if (term->context.reverse_video)
                 goto set_fg_bright;
 set_bg_bright:
-            term_set_text_bg_bright(term, term->context.esc_values[i] - offset);
+            term->ops->set_text_bg_bright(term->backend, term->context.esc_values[i] - offset);
             continue;
         }
         else if (term->context.esc_values[i] == 39)
@@ -727,22 +1599,22 @@ set_bg_bright:
             term->context.current_primary = (size_t)(-1);
 
             if (term->context.reverse_video)
-                term_swap_palette(term);
-            term_set_text_fg_default(term);
+                term->ops->swap_palette(term->backend);
+            term->ops->set_text_fg_default(term->backend);
             if (term->context.reverse_video)
-                term_swap_palette(term);
+                term->ops->swap_palette(term->backend);
 
             continue;
         }
         else if (term->context.esc_values[i] == 49)
         {
             if (term->context.reverse_video)
-                term_swap_palette(term);
+                term->ops->swap_palette(term->backend);
 
-            term_set_text_bg_default(term);
+            term->ops->set_text_bg_default(term->backend);
 
             if (term->context.reverse_video)
-                term_swap_palette(term);
+                term->ops->swap_palette(term->backend);
 
             continue;
         }
@@ -751,7 +1623,7 @@ set_bg_bright:
             if (!term->context.reverse_video)
             {
                 term->context.reverse_video = true;
-                term_swap_palette(term);
+                term->ops->swap_palette(term->backend);
             }
             continue;
         }
@@ -760,7 +1632,7 @@ set_bg_bright:
             if (term->context.reverse_video)
             {
                 term->context.reverse_video = false;
-                term_swap_palette(term);
+                term->ops->swap_palette(term->backend);
             }
             continue;
         }
@@ -786,7 +1658,7 @@ set_bg_bright:
 
                     i += 3;
 
-                    fg ? term_set_text_fg_rgb(term, rgb_value) : term_set_text_bg_rgb(term, rgb_value);
+                    fg ? term->ops->set_text_fg_rgb(term->backend, rgb_value) : term->ops->set_text_bg_rgb(term->backend, rgb_value);
 
                     break;
                 }
@@ -798,14 +1670,11 @@ set_bg_bright:
                     uint32_t col = term->context.esc_values[++i];
 
                     if (col < 8)
-                        fg ? term_set_text_fg(term, col) : term_set_text_bg(term, col);
+                        fg ? term->ops->set_text_fg(term->backend, col) : term->ops->set_text_bg(term->backend, col);
                     else if (col < 16)
-                        fg ? term_set_text_fg_bright(term, col - 8) : term_set_text_bg_bright(term, col - 8);
-                    else
-                    {
-                        uint32_t rgb_value = col256[col - 16];
-                        fg ? term_set_text_fg_rgb(term, rgb_value) : term_set_text_bg_rgb(term, rgb_value);
-                    }
+                        fg ? term->ops->set_text_fg_bright(term->backend, col - 8) : term->ops->set_text_bg_bright(term->backend, col - 8);
+                    else if (col < 256)
+                        fg ? term->ops->set_text_fg_indexed(term->backend, col) : term->ops->set_text_bg_indexed(term->backend, col);
 
                     break;
                 }
@@ -815,7 +1684,14 @@ set_bg_bright:
         }
     }
 
-out:;
+out:
+    term_update_attributes(term);
+}
+
+static void term_switch_screen(struct term_t *term, bool alt)
+{
+    if (alt != term->context.alt_screen && term->ops->swap_screen(term->backend))
+        term->context.alt_screen = alt;
 }
 
 void term_dec_private_parse(struct term_t *term, uint8_t c)
@@ -842,9 +1718,39 @@ void term_dec_private_parse(struct term_t *term, uint8_t c)
     {
         case 25:
             if (set == true)
-                term_enable_cursor(term);
+                term->ops->enable_cursor(term->backend);
             else
-                term_disable_cursor(term);
+                term->ops->disable_cursor(term->backend);
+            return;
+        case 2026:
+            // Without a clock there would be no way to recover from an application that never ends the update
+            if (term->clock == NULL || term->sync_timeout == 0)
+                break;
+
+            term->synchronised = set;
+            if (set == true)
+                term->sync_start = term->clock(term);
+            return;
+        case 47:
+            term_switch_screen(term, set);
+            return;
+        case 1047:
+            // The alternate screen is cleared on the way out
+            if (set == false && term->context.alt_screen)
+                term->ops->clear(term->backend, false);
+            term_switch_screen(term, set);
+            return;
+        case 1049:
+            // Saves the cursor as DECSC would and enters a cleared alternate screen
+            if (set == term->context.alt_screen)
+                return;
+            if (set == true)
+                term_save_state(term);
+            term_switch_screen(term, set);
+            if (set == true && term->context.alt_screen)
+                term->ops->clear(term->backend, false);
+            if (set == false)
+                term_restore_state(term);
             return;
     }
 
@@ -890,6 +1796,33 @@ void term_mode_toggle(struct term_t *term, uint8_t c)
         term->callback(term, TERM_CB_MODE, term->context.esc_values_i, (uintptr_t)(term->context.esc_values), c);
 }
 
+// DECSCUSR, 0 is the terminal's default steady block
+static void term_cursor_style(struct term_t *term, size_t style)
+{
+    switch (style)
+    {
+        case 0:
+        case 2:
+            term->ops->set_cursor_shape(term->backend, TERM_CURSOR_BLOCK, false);
+            break;
+        case 1:
+            term->ops->set_cursor_shape(term->backend, TERM_CURSOR_BLOCK, true);
+            break;
+        case 3:
+            term->ops->set_cursor_shape(term->backend, TERM_CURSOR_UNDERLINE, true);
+            break;
+        case 4:
+            term->ops->set_cursor_shape(term->backend, TERM_CURSOR_UNDERLINE, false);
+            break;
+        case 5:
+            term->ops->set_cursor_shape(term->backend, TERM_CURSOR_BAR, true);
+            break;
+        case 6:
+            term->ops->set_cursor_shape(term->backend, TERM_CURSOR_BAR, false);
+            break;
+    }
+}
+
 void term_control_sequence_parse(struct term_t *term, uint8_t c)
 {
     if (term->context.escape_offset == 2)
@@ -931,6 +1864,13 @@ void term_control_sequence_parse(struct term_t *term, uint8_t c)
         return;
     }
 
+    // Intermediate bytes come between the parameters and the final byte
+    if (c >= 0x20 && c <= 0x2F)
+    {
+        term->context.intermediate = c;
+        return;
+    }
+
     size_t esc_default;
     switch (c)
     {
@@ -953,10 +1893,17 @@ void term_control_sequence_parse(struct term_t *term, uint8_t c)
         goto cleanup;
     }
 
+    if (term->context.intermediate != 0)
+    {
+        if (term->context.intermediate == ' ' && c == 'q')
+            term_cursor_style(term, term->context.esc_values[0]);
+        goto cleanup;
+    }
+
     bool r;
-    r = term_scroll_disable(term);
+    r = term->ops->scroll_disable(term->backend);
     size_t x, y;
-    term_get_cursor_pos(term, &x, &y);
+    term->ops->get_cursor_pos(term->backend, &x, &y);
 
     switch (c) {
         case 'F':
@@ -974,7 +1921,7 @@ void term_control_sequence_parse(struct term_t *term, uint8_t c)
             if (will_be_in_scroll_region && dest_y < term->context.scroll_top_margin)
                 dest_y = term->context.scroll_top_margin;
 
-            term_set_cursor_pos(term, x, dest_y);
+            term->ops->set_cursor_pos(term->backend, x, dest_y);
             break;
         }
         case 'E':
@@ -993,23 +1940,22 @@ void term_control_sequence_parse(struct term_t *term, uint8_t c)
             if (will_be_in_scroll_region && dest_y >= term->context.scroll_bottom_margin)
                 dest_y = term->context.scroll_bottom_margin - 1;
 
-            term_set_cursor_pos(term, x, dest_y);
+            term->ops->set_cursor_pos(term->backend, x, dest_y);
             break;
         }
         case 'a':
         case 'C':
             if (x + term->context.esc_values[0] > term->cols - 1)
                 term->context.esc_values[0] = (term->cols - 1) - x;
-            term_set_cursor_pos(term, x + term->context.esc_values[0], y);
+            term->ops->set_cursor_pos(term->backend, x + term->context.esc_values[0], y);
             break;
         case 'D':
             if (term->context.esc_values[0] > x)
                 term->context.esc_values[0] = x;
-            term_set_cursor_pos(term, x - term->context.esc_values[0], y);
+            term->ops->set_cursor_pos(term->backend, x - term->context.esc_values[0], y);
             break;
         case 'c':
-            if (term->callback)
-                term->callback(term, TERM_CB_PRIVATE_ID, 0, 0, 0);
+            term_queue_response(term, "\033[?6c", 5);
             break;
         case 'd':
             term->context.esc_values[0] -= 1;
@@ -1017,7 +1963,7 @@ void term_control_sequence_parse(struct term_t *term, uint8_t c)
             if (term->context.esc_values[0] >= term->rows)
                 term->context.esc_values[0] = term->rows - 1;
 
-            term_set_cursor_pos(term, x, term->context.esc_values[0]);
+            term->ops->set_cursor_pos(term->backend, x, term->context.esc_values[0]);
             break;
         case 'G':
         case '`':
@@ -1026,7 +1972,7 @@ void term_control_sequence_parse(struct term_t *term, uint8_t c)
             if (term->context.esc_values[0] >= term->cols)
                 term->context.esc_values[0] = term->cols - 1;
 
-            term_set_cursor_pos(term, term->context.esc_values[0], y);
+            term->ops->set_cursor_pos(term->backend, term->context.esc_values[0], y);
             break;
         case 'H':
         case 'f':
@@ -1042,30 +1988,22 @@ void term_control_sequence_parse(struct term_t *term, uint8_t c)
             if (term->context.esc_values[0] >= term->rows)
                 term->context.esc_values[0] = term->rows - 1;
 
-            term_set_cursor_pos(term, term->context.esc_values[1], term->context.esc_values[0]);
+            term->ops->set_cursor_pos(term->backend, term->context.esc_values[1], term->context.esc_values[0]);
             break;
         case 'M':
-            for (size_t i = 0; i < term->context.esc_values[0]; i++)
-                term_scroll(term);
+            term->ops->delete_lines(term->backend, y, term->context.esc_values[0]);
             break;
-        case 'L': {
-            size_t old_scroll_top_margin = term->context.scroll_top_margin;
-            term->context.scroll_top_margin = y;
-            for (size_t i = 0; i < term->context.esc_values[0]; i++)
-                term_revscroll(term);
-            term->context.scroll_top_margin = old_scroll_top_margin;
+        case 'L':
+            term->ops->insert_lines(term->backend, y, term->context.esc_values[0]);
             break;
-        }
         case 'n':
             switch (term->context.esc_values[0])
             {
                 case 5:
-                    if (term->callback)
-                        term->callback(term, TERM_CB_STATUS_REPORT, 0, 0, 0);
+                    term_queue_response(term, "\033[0n", 4);
                     break;
                 case 6:
-                    if (term->callback)
-                        term->callback(term, TERM_CB_POS_REPORT, x + 1, y + 1, 0);
+                    term_report_position(term, x, y);
                     break;
             }
             break;
@@ -1083,23 +2021,23 @@ void term_control_sequence_parse(struct term_t *term, uint8_t c)
                     size_t to_clear = rows_remaining * term->cols + cols_diff;
 
                     for (size_t i = 0; i < to_clear; i++)
-                        term_raw_putchar(term, ' ');
+                        term->ops->putchar(term->backend, ' ');
 
-                    term_set_cursor_pos(term, x, y);
+                    term->ops->set_cursor_pos(term->backend, x, y);
                     break;
                 }
                 case 1:
                 {
-                    term_set_cursor_pos(term, 0, 0);
+                    term->ops->set_cursor_pos(term->backend, 0, 0);
                     bool b = false;
                     for (size_t yc = 0; yc < term->rows; yc++)
                     {
                         for (size_t xc = 0; xc < term->cols; xc++)
                         {
-                            term_raw_putchar(term, ' ');
+                            term->ops->putchar(term->backend, ' ');
                             if (xc == x && yc == y)
                             {
-                                term_set_cursor_pos(term, x, y);
+                                term->ops->set_cursor_pos(term->backend, x, y);
                                 b = true;
                                 break;
                             }
@@ -1111,58 +2049,74 @@ void term_control_sequence_parse(struct term_t *term, uint8_t c)
                 }
                 case 2:
                 case 3:
-                    term_clear(term, false);
+                    term->ops->clear(term->backend, false);
                     break;
             }
             break;
         case '@':
-            for (size_t i = term->cols - 1; ; i--)
-            {
-                term_move_character(term, i + term->context.esc_values[0], y, i, y);
-                term_set_cursor_pos(term, i, y);
-                term_raw_putchar(term, ' ');
-                if (i == x)
-                    break;
-            }
-            term_set_cursor_pos(term, x, y);
+            term->ops->insert_chars(term->backend, x, y, term->context.esc_values[0]);
             break;
         case 'P':
-            for (size_t i = x + term->context.esc_values[0]; i < term->cols; i++)
-                term_move_character(term, i - term->context.esc_values[0], y, i, y);
-            term_set_cursor_pos(term, term->cols - term->context.esc_values[0], y);
-            // FALLTHRU
+            term->ops->delete_chars(term->backend, x, y, term->context.esc_values[0]);
+            break;
         case 'X':
             for (size_t i = 0; i < term->context.esc_values[0]; i++)
-                term_raw_putchar(term, ' ');
-            term_set_cursor_pos(term, x, y);
+                term->ops->putchar(term->backend, ' ');
+            term->ops->set_cursor_pos(term->backend, x, y);
+            break;
+        case 'b':
+        {
+            if (term->context.last_char == 0)
+                break;
+
+            size_t count = term->context.esc_values[0];
+            size_t screen = term->rows * term->cols;
+
+            // Once the whole screen has been filled, further full lines only scroll identical rows
+            if (count > screen)
+                count = screen + (count - screen) % term->cols;
+
+            if (term->context.insert_mode == true)
+                term->ops->insert_chars(term->backend, x, y, count);
+
+            if (r == true)
+                term->ops->scroll_enable(term->backend);
+            term->ops->repeat_char(term->backend, term->context.last_char, count);
+            break;
+        }
+        case 'S':
+            term->ops->delete_lines(term->backend, term->context.scroll_top_margin, term->context.esc_values[0]);
+            break;
+        case 'T':
+            term->ops->insert_lines(term->backend, term->context.scroll_top_margin, term->context.esc_values[0]);
             break;
         case 'm':
             term_sgr(term);
             break;
         case 's':
-            term_get_cursor_pos(term, &term->context.saved_cursor_x, &term->context.saved_cursor_y);
+            term->ops->get_cursor_pos(term->backend, &term->context.saved_cursor_x, &term->context.saved_cursor_y);
             break;
         case 'u':
-            term_set_cursor_pos(term, term->context.saved_cursor_x, term->context.saved_cursor_y);
+            term->ops->set_cursor_pos(term->backend, term->context.saved_cursor_x, term->context.saved_cursor_y);
             break;
         case 'K':
             switch (term->context.esc_values[0])
             {
                 case 0:
                     for (size_t i = x; i < term->cols; i++)
-                        term_raw_putchar(term, ' ');
-                    term_set_cursor_pos(term, x, y);
+                        term->ops->putchar(term->backend, ' ');
+                    term->ops->set_cursor_pos(term->backend, x, y);
                     break;
                 case 1:
-                    term_set_cursor_pos(term, 0, y);
+                    term->ops->set_cursor_pos(term->backend, 0, y);
                     for (size_t i = 0; i < x; i++)
-                        term_raw_putchar(term, ' ');
+                        term->ops->putchar(term->backend, ' ');
                     break;
                 case 2:
-                    term_set_cursor_pos(term, 0, y);
+                    term->ops->set_cursor_pos(term->backend, 0, y);
                     for (size_t i = 0; i < term->cols; i++)
-                        term_raw_putchar(term, ' ');
-                    term_set_cursor_pos(term, x, y);
+                        term->ops->putchar(term->backend, ' ');
+                    term->ops->set_cursor_pos(term->backend, x, y);
                     break;
             }
             break;
@@ -1185,7 +2139,7 @@ void term_control_sequence_parse(struct term_t *term, uint8_t c)
                 term->context.scroll_top_margin = 0;
                 term->context.scroll_bottom_margin = term->rows;
             }
-            term_set_cursor_pos(term, 0, 0);
+            term->ops->set_cursor_pos(term->backend, 0, 0);
             break;
         case 'l':
         case 'h':
@@ -1197,7 +2151,7 @@ void term_control_sequence_parse(struct term_t *term, uint8_t c)
     }
 
     if (r == true)
-        term_scroll_enable(term);
+        term->ops->scroll_enable(term->backend);
 
 cleanup:
     term->context.control_sequence = false;
@@ -1221,7 +2175,7 @@ void term_escape_parse(struct term_t *term, uint8_t c)
     }
 
     size_t x, y;
-    term_get_cursor_pos(term, &x, &y);
+    term->ops->get_cursor_pos(term->backend, &x, &y);
 
     switch (c)
     {
@@ -1231,6 +2185,7 @@ is_csi:
                 term->context.esc_values[i] = 0;
             term->context.esc_values_i = 0;
             term->context.rrr = false;
+            term->context.intermediate = 0;
             term->context.control_sequence = true;
             return;
         case '7':
@@ -1240,36 +2195,36 @@ is_csi:
             term_restore_state(term);
             break;
         case 'c':
+            term_switch_screen(term, false);
             term_reinit(term);
-            term_clear(term, true);
+            term->ops->clear(term->backend, true);
             break;
         case 'D':
             if (y == term->context.scroll_bottom_margin - 1)
             {
-                term_scroll(term);
-                term_set_cursor_pos(term, x, y);
+                term->ops->scroll(term->backend);
+                term->ops->set_cursor_pos(term->backend, x, y);
             }
-            else term_set_cursor_pos(term, x, y + 1);
+            else term->ops->set_cursor_pos(term->backend, x, y + 1);
             break;
         case 'E':
             if (y == term->context.scroll_bottom_margin - 1)
             {
-                term_scroll(term);
-                term_set_cursor_pos(term, 0, y);
+                term->ops->scroll(term->backend);
+                term->ops->set_cursor_pos(term->backend, 0, y);
             }
-            else term_set_cursor_pos(term, 0, y + 1);
+            else term->ops->set_cursor_pos(term->backend, 0, y + 1);
             break;
         case 'M':
             if (y == term->context.scroll_top_margin)
             {
-                term_revscroll(term);
-                term_set_cursor_pos(term, 0, y);
+                term->ops->revscroll(term->backend);
+                term->ops->set_cursor_pos(term->backend, 0, y);
             }
-            else term_set_cursor_pos(term, 0, y - 1);
+            else term->ops->set_cursor_pos(term->backend, 0, y - 1);
             break;
         case 'Z':
-            if (term->callback)
-                term->callback(term, TERM_CB_PRIVATE_ID, 0, 0, 0);
+            term_queue_response(term, "\033[?6c", 5);
             break;
         case '(':
         case ')':
@@ -1287,12 +2242,23 @@ void term_raw_putchar(struct term_t *term, uint8_t c)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_putchar(term->gterm, c);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_putchar(term->tterm, c);
-#endif
+    term->ops->putchar(term->backend, c);
+}
+
+void term_repeat_char(struct term_t *term, uint8_t c, size_t count)
+{
+    if (term->initialised == false)
+        return;
+
+    term->ops->repeat_char(term->backend, c, count);
+}
+
+bool term_put_code_point(struct term_t *term, uint32_t code_point)
+{
+    if (term->initialised == false)
+        return false;
+
+    return term->ops->put_code_point(term->backend, code_point);
 }
 
 void term_clear(struct term_t *term, bool move)
@@ -1300,12 +2266,7 @@ void term_clear(struct term_t *term, bool move)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_clear(term->gterm, move);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_clear(term->tterm, move);
-#endif
+    term->ops->clear(term->backend, move);
 }
 
 void term_enable_cursor(struct term_t *term)
@@ -1313,12 +2274,7 @@ void term_enable_cursor(struct term_t *term)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_enable_cursor(term->gterm);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_enable_cursor(term->tterm);
-#endif
+    term->ops->enable_cursor(term->backend);
 }
 
 bool term_disable_cursor(struct term_t *term)
@@ -1326,13 +2282,15 @@ bool term_disable_cursor(struct term_t *term)
     if (term->initialised == false)
         return false;
 
-    if (term->term_backend == VBE && term->gterm)
-        return gterm_disable_cursor(term->gterm);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        return tterm_disable_cursor(term->tterm);
-#endif
-    return false;
+    return term->ops->disable_cursor(term->backend);
+}
+
+void term_set_cursor_shape(struct term_t *term, size_t shape, bool blink)
+{
+    if (term->initialised == false)
+        return;
+
+    term->ops->set_cursor_shape(term->backend, shape, blink);
 }
 
 void term_set_cursor_pos(struct term_t *term, size_t x, size_t y)
@@ -1340,12 +2298,7 @@ void term_set_cursor_pos(struct term_t *term, size_t x, size_t y)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_set_cursor_pos(term->gterm, x, y);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_set_cursor_pos(term->tterm, x, y);
-#endif
+    term->ops->set_cursor_pos(term->backend, x, y);
 }
 
 void term_get_cursor_pos(struct term_t *term, size_t *x, size_t *y)
@@ -1353,12 +2306,7 @@ void term_get_cursor_pos(struct term_t *term, size_t *x, size_t *y)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_get_cursor_pos(term->gterm, x, y);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_get_cursor_pos(term->tterm, x, y);
-#endif
+    term->ops->get_cursor_pos(term->backend, x, y);
 }
 
 void term_set_text_fg(struct term_t *term, size_t fg)
@@ -1366,12 +2314,7 @@ void term_set_text_fg(struct term_t *term, size_t fg)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_set_text_fg(term->gterm, fg);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_set_text_fg(term->tterm, fg);
-#endif
+    term->ops->set_text_fg(term->backend, fg);
 }
 
 void term_set_text_bg(struct term_t *term, size_t bg)
@@ -1379,12 +2322,7 @@ void term_set_text_bg(struct term_t *term, size_t bg)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_set_text_bg(term->gterm, bg);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_set_text_bg(term->tterm, bg);
-#endif
+    term->ops->set_text_bg(term->backend, bg);
 }
 
 void term_set_text_fg_bright(struct term_t *term, size_t fg)
@@ -1392,12 +2330,7 @@ void term_set_text_fg_bright(struct term_t *term, size_t fg)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_set_text_fg_bright(term->gterm, fg);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_set_text_fg_bright(term->tterm, fg);
-#endif
+    term->ops->set_text_fg_bright(term->backend, fg);
 }
 
 void term_set_text_bg_bright(struct term_t *term, size_t bg)
@@ -1405,12 +2338,7 @@ void term_set_text_bg_bright(struct term_t *term, size_t bg)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_set_text_bg_bright(term->gterm, bg);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_set_text_bg_bright(term->tterm, bg);
-#endif
+    term->ops->set_text_bg_bright(term->backend, bg);
 }
 
 void term_set_text_fg_rgb(struct term_t *term, uint32_t fg)
@@ -1418,8 +2346,7 @@ void term_set_text_fg_rgb(struct term_t *term, uint32_t fg)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_set_text_fg_rgb(term->gterm, fg);
+    term->ops->set_text_fg_rgb(term->backend, fg);
 }
 
 void term_set_text_bg_rgb(struct term_t *term, uint32_t bg)
@@ -1427,8 +2354,31 @@ void term_set_text_bg_rgb(struct term_t *term, uint32_t bg)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_set_text_bg_rgb(term->gterm, bg);
+    term->ops->set_text_bg_rgb(term->backend, bg);
+}
+
+void term_set_text_fg_indexed(struct term_t *term, size_t fg)
+{
+    if (term->initialised == false)
+        return;
+
+    term->ops->set_text_fg_indexed(term->backend, fg);
+}
+
+void term_set_text_bg_indexed(struct term_t *term, size_t bg)
+{
+    if (term->initialised == false)
+        return;
+
+    term->ops->set_text_bg_indexed(term->backend, bg);
+}
+
+void term_set_text_attributes(struct term_t *term, uint32_t attributes)
+{
+    if (term->initialised == false)
+        return;
+
+    term->ops->set_text_attributes(term->backend, attributes & TERM_ATTR_MASK);
 }
 
 void term_set_text_fg_default(struct term_t *term)
@@ -1436,12 +2386,7 @@ void term_set_text_fg_default(struct term_t *term)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_set_text_fg_default(term->gterm);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_set_text_fg_default(term->tterm);
-#endif
+    term->ops->set_text_fg_default(term->backend);
 }
 
 void term_set_text_bg_default(struct term_t *term)
@@ -1449,12 +2394,7 @@ void term_set_text_bg_default(struct term_t *term)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_set_text_bg_default(term->gterm);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_set_text_bg_default(term->tterm);
-#endif
+    term->ops->set_text_bg_default(term->backend);
 }
 
 bool term_scroll_disable(struct term_t *term)
@@ -1462,13 +2402,7 @@ bool term_scroll_disable(struct term_t *term)
     if (term->initialised == false)
         return false;
 
-    if (term->term_backend == VBE && term->gterm)
-        return gterm_scroll_disable(term->gterm);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        return tterm_scroll_disable(term->tterm);
-#endif
-    return false;
+    return term->ops->scroll_disable(term->backend);
 }
 
 void term_scroll_enable(struct term_t *term)
@@ -1476,12 +2410,7 @@ void term_scroll_enable(struct term_t *term)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_scroll_enable(term->gterm);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_scroll_enable(term->tterm);
-#endif
+    term->ops->scroll_enable(term->backend);
 }
 
 void term_move_character(struct term_t *term, size_t new_x, size_t new_y, size_t old_x, size_t old_y)
@@ -1489,12 +2418,39 @@ void term_move_character(struct term_t *term, size_t new_x, size_t new_y, size_t
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_move_character(term->gterm, new_x, new_y, old_x, old_y);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_move_character(term->tterm, new_x, new_y, old_x, old_y);
-#endif
+    term->ops->move_character(term->backend, new_x, new_y, old_x, old_y);
+}
+
+void term_insert_chars(struct term_t *term, size_t x, size_t y, size_t count)
+{
+    if (term->initialised == false)
+        return;
+
+    term->ops->insert_chars(term->backend, x, y, count);
+}
+
+void term_delete_chars(struct term_t *term, size_t x, size_t y, size_t count)
+{
+    if (term->initialised == false)
+        return;
+
+    term->ops->delete_chars(term->backend, x, y, count);
+}
+
+void term_insert_lines(struct term_t *term, size_t y, size_t count)
+{
+    if (term->initialised == false)
+        return;
+
+    term->ops->insert_lines(term->backend, y, count);
+}
+
+void term_delete_lines(struct term_t *term, size_t y, size_t count)
+{
+    if (term->initialised == false)
+        return;
+
+    term->ops->delete_lines(term->backend, y, count);
 }
 
 void term_scroll(struct term_t *term)
@@ -1502,12 +2458,7 @@ void term_scroll(struct term_t *term)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_scroll(term->gterm);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_scroll(term->tterm);
-#endif
+    term->ops->scroll(term->backend);
 }
 
 void term_revscroll(struct term_t *term)
@@ -1515,12 +2466,7 @@ void term_revscroll(struct term_t *term)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_revscroll(term->gterm);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_revscroll(term->tterm);
-#endif
+    term->ops->revscroll(term->backend);
 }
 
 void term_swap_palette(struct term_t *term)
@@ -1528,12 +2474,7 @@ void term_swap_palette(struct term_t *term)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_swap_palette(term->gterm);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_swap_palette(term->tterm);
-#endif
+    term->ops->swap_palette(term->backend);
 }
 
 void term_save_state(struct term_t *term)
@@ -1541,17 +2482,13 @@ void term_save_state(struct term_t *term)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_save_state(term->gterm);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_save_state(term->tterm);
-#endif
+    term->ops->save_state(term->backend);
 
     term->context.saved_state_bold = term->context.bold;
     term->context.saved_state_reverse_video = term->context.reverse_video;
     term->context.saved_state_current_charset = term->context.current_charset;
     term->context.saved_state_current_primary = term->context.current_primary;
+    term->context.saved_state_attributes = term->context.attributes;
 }
 
 void term_restore_state(struct term_t *term)
@@ -1563,13 +2500,10 @@ void term_restore_state(struct term_t *term)
     term->context.reverse_video = term->context.saved_state_reverse_video;
     term->context.current_charset = term->context.saved_state_current_charset;
     term->context.current_primary = term->context.saved_state_current_primary;
+    term->context.attributes = term->context.saved_state_attributes;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_restore_state(term->gterm);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_restore_state(term->tterm);
-#endif
+    term->ops->restore_state(term->backend);
+    term_update_attributes(term);
 }
 
 void term_double_buffer_flush(struct term_t *term)
@@ -1577,29 +2511,32 @@ void term_double_buffer_flush(struct term_t *term)
     if (term->initialised == false)
         return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_double_buffer_flush(term->gterm);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_double_buffer_flush(term->tterm);
-#endif
+    if (term->hidden)
+        term->ops->logical_flush(term->backend);
+    else
+        term->ops->double_buffer_flush(term->backend);
 }
 
-uint64_t term_context_size(struct term_t *term)
+bool term_flush_budget(struct term_t *term, size_t max_cells, uint64_t max_time)
 {
     if (term->initialised == false)
-        return 0;
+        return true;
 
-    uint64_t ret = sizeof(struct term_context);
+    if (term->hidden)
+    {
+        term->ops->logical_flush(term->backend);
+        return true;
+    }
 
-    if (term->term_backend == VBE && term->gterm)
-        ret += gterm_context_size(term->gterm);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        ret += tterm_context_size(term->tterm);
-#endif
+    return term->ops->flush_budget(term->backend, max_cells, max_time);
+}
+
+uint64_t term_context_size(struct term_t *term)
+{
+    if (term->initialised == false)
+        return 0;
 
-    return ret;
+    return sizeof(struct term_context) + term->ops->context_size(term->backend);
 }
 
 void term_context_save(struct term_t *term, uint64_t ptr)
@@ -1610,38 +2547,31 @@ void term_context_save(struct term_t *term, uint64_t ptr)
     memcpy((void*)ptr, &term->context, sizeof(struct term_context));
     ptr += sizeof(struct term_context);
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_context_save(term->gterm, ptr);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_context_save(term->tterm, ptr);
-#endif
+    term->ops->context_save(term->backend, ptr);
 }
 
+// The saved cells are those of the screen that was showing, so that screen is brought back
+// first. The cells queued by the switch only go to the grid, the backend draws the saved ones.
 void term_context_restore(struct term_t *term, uint64_t ptr)
 {
     if (term->initialised == false)
         return;
 
+    term_switch_screen(term, ((struct term_context*)ptr)->alt_screen);
+    term->ops->logical_flush(term->backend);
+    bool alt_screen = term->context.alt_screen;
+
     memcpy(&term->context, (void*)ptr, sizeof(struct term_context));
     ptr += sizeof(struct term_context);
+    term->context.alt_screen = alt_screen;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_context_restore(term->gterm, ptr);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_context_restore(term->tterm, ptr);
-#endif
+    term->ops->context_restore(term->backend, ptr);
 }
 
 void term_full_refresh(struct term_t *term)
 {
-    if (term->initialised == false) return;
+    if (term->initialised == false)
+        return;
 
-    if (term->term_backend == VBE && term->gterm)
-        gterm_full_refresh(term->gterm);
-#if defined(__i386__) || defined(__x86_64__)
-    else if (term->term_backend == TEXTMODE && term->tterm)
-        tterm_full_refresh(term->tterm);
-#endif
+    term->ops->full_refresh(term->backend);
 }
\ No newline at end of file
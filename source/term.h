@@ -2,6 +2,8 @@
 #define TERM_H
 
 #include "image.h"
+#include "font.h"
+#include "ttf.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -12,10 +14,23 @@ extern void free_mem(void *ptr, size_t size);
 extern void *memcpy(void *dest, const void *src, size_t len);
 extern void *memset(void *dest, int ch, size_t n);
 
-#define FONT_GLYPHS 256
+// Cell characters carry the glyph in their low bits and these attributes above it
+#define TERM_ATTR_BOLD (1u << 24)
+#define TERM_ATTR_ITALIC (1u << 25)
+#define TERM_ATTR_UNDERLINE (1u << 26)
+#define TERM_ATTR_STRIKE (1u << 27)
+#define TERM_ATTR_MASK (0xFu << 24)
+#define TERM_CELL_GLYPH(c) ((c) & 0xFFFFFF)
+
+// Cursor shapes set by DECSCUSR (CSI Ps SP q)
+#define TERM_CURSOR_BLOCK 0
+#define TERM_CURSOR_UNDERLINE 1
+#define TERM_CURSOR_BAR 2
 
 #define TERM_TABSIZE 8
 #define MAX_ESC_VALUES 16
+#define TERM_RESPONSE_BUFFER_SIZE 256
+#define TERM_MAX_PARALLEL_BANDS 64
 
 #define CHARSET_DEFAULT 0
 #define CHARSET_DEC_SPECIAL 1
@@ -31,6 +46,10 @@ extern void *memset(void *dest, int ch, size_t n);
 
 struct term_t;
 typedef void (*callback_t)(struct term_t*, uint64_t, uint64_t, uint64_t, uint64_t);
+typedef uint64_t (*clock_callback_t)(struct term_t*);
+typedef void (*parallel_job_t)(void*);
+typedef void (*parallel_submit_t)(struct term_t*, parallel_job_t, void*);
+typedef void (*parallel_wait_t)(struct term_t*);
 typedef size_t fixedp6;
 
 static inline size_t fixedp6_to_int(fixedp6 value)
@@ -51,13 +70,15 @@ enum callbacks
     TERM_CB_POS_REPORT = 50,
     TERM_CB_KBD_LEDS = 60,
     TERM_CB_MODE = 70,
-    TERM_CB_LINUX = 80
+    TERM_CB_LINUX = 80,
+    TERM_CB_RESPONSE = 90
 };
 
 enum term_type
 {
     NOT_READY,
     VBE,
+    CUSTOM,
 #if defined(__i386__) || defined(__x86_64__)
     TEXTMODE
 #endif
@@ -71,16 +92,6 @@ struct framebuffer_t
     uint64_t pitch;
 };
 
-struct font_t
-{
-    uintptr_t address;
-    uint8_t width;
-    uint8_t height;
-    uint8_t spacing;
-    uint8_t scale_x;
-    uint8_t scale_y;
-};
-
 struct style_t
 {
     uint32_t ansi_colours[8];
@@ -106,9 +117,12 @@ struct term_context
     bool rrr;
     bool discard_next;
     bool bold;
+    uint32_t attributes;
     bool reverse_video;
     bool dec_private;
+    uint8_t intermediate;
     bool insert_mode;
+    uint8_t last_char;
     uint64_t code_point;
     size_t unicode_remaining;
     uint8_t g_select;
@@ -127,6 +141,85 @@ struct term_context
     bool saved_state_reverse_video;
     size_t saved_state_current_charset;
     size_t saved_state_current_primary;
+    uint32_t saved_state_attributes;
+
+    bool alt_screen;
+};
+
+struct term_cell
+{
+    uint32_t c;
+    uint32_t fg;
+    uint32_t bg;
+};
+
+struct term_snapshot
+{
+    size_t cols, rows;
+    size_t cursor_x, cursor_y;
+    bool cursor_visible;
+
+    // Provided by the caller, with room for size cells
+    struct term_cell *cells;
+    size_t size;
+};
+
+// Tables passed to term_custom_backend() may leave entries NULL, those do nothing. Hosts
+// written against an older revision keep working as entries are added. Every member has to
+// stay a function pointer.
+struct term_backend_ops
+{
+    void (*deinit)(void *backend);
+    void (*putchar)(void *backend, uint8_t c);
+    void (*repeat_char)(void *backend, uint8_t c, size_t count);
+    void (*clear)(void *backend, bool move);
+    void (*enable_cursor)(void *backend);
+    bool (*disable_cursor)(void *backend);
+    void (*set_cursor_pos)(void *backend, size_t x, size_t y);
+    void (*get_cursor_pos)(void *backend, size_t *x, size_t *y);
+    void (*set_text_fg)(void *backend, size_t fg);
+    void (*set_text_bg)(void *backend, size_t bg);
+    void (*set_text_fg_bright)(void *backend, size_t fg);
+    void (*set_text_bg_bright)(void *backend, size_t bg);
+    void (*set_text_fg_rgb)(void *backend, uint32_t fg);
+    void (*set_text_bg_rgb)(void *backend, uint32_t bg);
+    void (*set_text_fg_default)(void *backend);
+    void (*set_text_bg_default)(void *backend);
+    void (*set_text_attributes)(void *backend, uint32_t attributes);
+    bool (*scroll_disable)(void *backend);
+    void (*scroll_enable)(void *backend);
+    void (*move_character)(void *backend, size_t new_x, size_t new_y, size_t old_x, size_t old_y);
+    void (*insert_chars)(void *backend, size_t x, size_t y, size_t count);
+    void (*delete_chars)(void *backend, size_t x, size_t y, size_t count);
+    void (*insert_lines)(void *backend, size_t y, size_t count);
+    void (*delete_lines)(void *backend, size_t y, size_t count);
+    void (*scroll)(void *backend);
+    void (*revscroll)(void *backend);
+    void (*swap_palette)(void *backend);
+    void (*save_state)(void *backend);
+    void (*restore_state)(void *backend);
+    void (*double_buffer_flush)(void *backend);
+    bool (*flush_budget)(void *backend, size_t max_cells, uint64_t max_time);
+    uint64_t (*context_size)(void *backend);
+    void (*context_save)(void *backend, uint64_t ptr);
+    void (*context_restore)(void *backend, uint64_t ptr);
+    void (*full_refresh)(void *backend);
+    void (*panic)(void *backend);
+    void (*panic_write)(void *backend, const char *buf, size_t count);
+    void (*snapshot)(void *backend, struct term_snapshot *snap);
+    void (*logical_flush)(void *backend);
+    void (*draw_cell)(void *backend, size_t x, size_t y, const struct term_cell *c);
+    void (*draw_background)(void *backend);
+    bool (*set_scrollback)(void *backend, size_t lines);
+    void (*scroll_viewport)(void *backend, int64_t lines);
+    bool (*swap_screen)(void *backend);
+    void (*set_text_fg_indexed)(void *backend, size_t fg);
+    void (*set_text_bg_indexed)(void *backend, size_t bg);
+    void (*set_palette)(void *backend, size_t index, uint32_t rgb);
+    void (*reset_palette)(void *backend);
+    bool (*put_code_point)(void *backend, uint32_t code_point);
+    void (*set_cursor_shape)(void *backend, size_t shape, bool blink);
+    bool (*cursor_tick)(void *backend);
 };
 
 struct gterm_t;
@@ -146,24 +239,92 @@ struct term_t
     bool initialised;
 
     enum term_type term_backend;
+    const struct term_backend_ops *ops;
+    struct term_backend_ops custom_ops;
+    void *backend;
     size_t rows, cols;
 
     size_t tab_size;
     bool autoflush;
+    bool panic;
+    size_t seq;
+
+    bool synchronised;
+    uint64_t sync_start;
+    uint64_t sync_timeout;
+
+    uint64_t frame_interval;
+    uint64_t last_present;
+    bool present_pending;
+
+    uint8_t response_buffer[TERM_RESPONSE_BUFFER_SIZE];
+    size_t response_head;
+    size_t response_tail;
+    bool response_pending;
+
+    uint8_t *ring;
+    size_t ring_size;
+    size_t ring_reserve;
+    size_t ring_tail;
+    size_t ring_dropped;
+
+    bool split_render;
+    struct term_cell *render_buffer;
+    size_t render_buffer_size;
+    struct term_snapshot render_slots[3];
+    size_t render_back;
+    size_t render_front;
+    size_t render_latest;
+    struct term_cell *render_screen;
+    bool render_reset;
+
+    bool hidden;
 
     callback_t callback;
+    clock_callback_t clock;
+
+    parallel_submit_t parallel_submit;
+    parallel_wait_t parallel_wait;
+    size_t parallel_workers;
 };
 
 void term_init(struct term_t *term, callback_t callback, bool bios, size_t tabsize);
 void term_deinit(struct term_t *term);
 void term_reinit(struct term_t *term);
 void term_vbe(struct term_t *term, struct framebuffer_t frm, struct font_t font, struct style_t style, struct background_t back);
+void term_vbe_attach(struct term_t *term, struct framebuffer_t frm, struct term_t *source);
 #if defined(__i386__) || defined(__x86_64__)
 void term_textmode(struct term_t *term);
 #endif
+void term_custom_backend(struct term_t *term, const struct term_backend_ops *ops, void *backend, size_t cols, size_t rows);
 void term_notready(struct term_t *term);
+void term_set_clock(struct term_t *term, clock_callback_t clock);
+void term_set_sync_timeout(struct term_t *term, uint64_t timeout);
+void term_set_parallel_hooks(struct term_t *term, parallel_submit_t submit, parallel_wait_t wait, size_t nworkers);
+void term_parallel_for(struct term_t *term, size_t start, size_t end, void (*fn)(void *ctx, size_t start, size_t end), void *ctx);
+void term_seq_begin(struct term_t *term);
+void term_seq_end(struct term_t *term);
+void term_set_frame_interval(struct term_t *term, uint64_t interval);
+void term_present(struct term_t *term);
+bool term_tick(struct term_t *term);
+bool term_cursor_tick(struct term_t *term);
+bool term_set_split_render(struct term_t *term, bool enable);
+bool term_render(struct term_t *term);
+void term_set_visible(struct term_t *term, bool visible);
+void term_set_palette(struct term_t *term, size_t index, uint32_t rgb);
+void term_reset_palette(struct term_t *term);
+bool term_set_scrollback(struct term_t *term, size_t lines);
+void term_scroll_viewport(struct term_t *term, int64_t lines);
+void term_viewport_reset(struct term_t *term);
 void term_putchar(struct term_t *term, uint8_t c);
 void term_write(struct term_t *term, const char *buf, size_t count);
+void term_panic(struct term_t *term);
+void term_panic_write(struct term_t *term, const char *buf, size_t count);
+size_t term_read_responses(struct term_t *term, char *buf, size_t count);
+void term_set_ring(struct term_t *term, void *buffer, size_t size);
+bool term_ring_write(struct term_t *term, const char *buf, size_t count);
+void term_ring_drain(struct term_t *term);
+bool term_read_snapshot(struct term_t *term, struct term_snapshot *snap);
 void term_sgr(struct term_t *term);
 void term_dec_private_parse(struct term_t *term, uint8_t c);
 void term_linux_private_parse(struct term_t *term);
@@ -172,9 +333,12 @@ void term_control_sequence_parse(struct term_t *term, uint8_t c);
 void term_escape_parse(struct term_t *term, uint8_t c);
 
 void term_raw_putchar(struct term_t *term, uint8_t c);
+void term_repeat_char(struct term_t *term, uint8_t c, size_t count);
+bool term_put_code_point(struct term_t *term, uint32_t code_point);
 void term_clear(struct term_t *term, bool move);
 void term_enable_cursor(struct term_t *term);
 bool term_disable_cursor(struct term_t *term);
+void term_set_cursor_shape(struct term_t *term, size_t shape, bool blink);
 void term_set_cursor_pos(struct term_t *term, size_t x, size_t y);
 void term_get_cursor_pos(struct term_t *term, size_t *x, size_t *y);
 void term_set_text_fg(struct term_t *term, size_t fg);
@@ -183,17 +347,25 @@ void term_set_text_fg_bright(struct term_t *term, size_t fg);
 void term_set_text_bg_bright(struct term_t *term, size_t bg);
 void term_set_text_fg_rgb(struct term_t *term, uint32_t fg);
 void term_set_text_bg_rgb(struct term_t *term, uint32_t bg);
+void term_set_text_fg_indexed(struct term_t *term, size_t fg);
+void term_set_text_bg_indexed(struct term_t *term, size_t bg);
+void term_set_text_attributes(struct term_t *term, uint32_t attributes);
 void term_set_text_fg_default(struct term_t *term);
 void term_set_text_bg_default(struct term_t *term);
 bool term_scroll_disable(struct term_t *term);
 void term_scroll_enable(struct term_t *term);
 void term_move_character(struct term_t *term, size_t new_x, size_t new_y, size_t old_x, size_t old_y);
+void term_insert_chars(struct term_t *term, size_t x, size_t y, size_t count);
+void term_delete_chars(struct term_t *term, size_t x, size_t y, size_t count);
+void term_insert_lines(struct term_t *term, size_t y, size_t count);
+void term_delete_lines(struct term_t *term, size_t y, size_t count);
 void term_scroll(struct term_t *term);
 void term_revscroll(struct term_t *term);
 void term_swap_palette(struct term_t *term);
 void term_save_state(struct term_t *term);
 void term_restore_state(struct term_t *term);
 void term_double_buffer_flush(struct term_t *term);
+bool term_flush_budget(struct term_t *term, size_t max_cells, uint64_t max_time);
 uint64_t term_context_size(struct term_t *term);
 void term_context_save(struct term_t *term, uint64_t ptr);
 void term_context_restore(struct term_t *term, uint64_t ptr);
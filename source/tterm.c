@@ -27,6 +27,14 @@ void tterm_init(struct tterm_t *tterm, struct term_t *term)
     else
         memset(tterm->front_buffer, 0, VD_ROWS * VD_COLS);
 
+    // A terminal set up again while on the alternate screen left the old main screen in there,
+    // the next switch makes a blank one
+    if (tterm->alt_buffer != NULL)
+    {
+        free_mem(tterm->alt_buffer, VD_ROWS * VD_COLS);
+        tterm->alt_buffer = NULL;
+    }
+
     tterm->context.cursor_offset = 0;
     tterm->context.cursor_status = true;
     tterm->context.text_palette = 0x07;
@@ -61,6 +69,12 @@ void tterm_putchar(struct tterm_t *tterm, uint8_t c)
         tterm->context.cursor_offset += 2;
 }
 
+void tterm_repeat_char(struct tterm_t *tterm, uint8_t c, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        tterm_putchar(tterm, c);
+}
+
 void tterm_clear(struct tterm_t *tterm, bool move)
 {
     for (size_t i = 0; i < VIDEO_BOTTOM; i += 2)
@@ -161,6 +175,92 @@ void tterm_move_character(struct tterm_t *tterm, size_t new_x, size_t new_y, siz
     tterm->back_buffer[new_y * VD_COLS + new_x * 2] = tterm->back_buffer[old_y * VD_COLS + old_x * 2];
 }
 
+void tterm_insert_chars(struct tterm_t *tterm, size_t x, size_t y, size_t count)
+{
+    if (x >= VD_COLS / 2 || y >= VD_ROWS || count == 0)
+        return;
+
+    if (count > VD_COLS / 2 - x)
+        count = VD_COLS / 2 - x;
+
+    size_t start = y * VD_COLS + x * 2;
+    size_t end = (y + 1) * VD_COLS;
+
+    for (size_t i = end - 1; i >= start + count * 2; i--)
+        tterm->back_buffer[i] = tterm->back_buffer[i - count * 2];
+
+    for (size_t i = start; i < start + count * 2; i += 2)
+    {
+        tterm->back_buffer[i] = ' ';
+        tterm->back_buffer[i + 1] = tterm->context.text_palette;
+    }
+}
+
+void tterm_delete_chars(struct tterm_t *tterm, size_t x, size_t y, size_t count)
+{
+    if (x >= VD_COLS / 2 || y >= VD_ROWS || count == 0)
+        return;
+
+    if (count > VD_COLS / 2 - x)
+        count = VD_COLS / 2 - x;
+
+    size_t start = y * VD_COLS + x * 2;
+    size_t end = (y + 1) * VD_COLS;
+
+    for (size_t i = start; i < end - count * 2; i++)
+        tterm->back_buffer[i] = tterm->back_buffer[i + count * 2];
+
+    for (size_t i = end - count * 2; i < end; i += 2)
+    {
+        tterm->back_buffer[i] = ' ';
+        tterm->back_buffer[i + 1] = tterm->context.text_palette;
+    }
+}
+
+void tterm_insert_lines(struct tterm_t *tterm, size_t y, size_t count)
+{
+    size_t bottom = tterm->term->context.scroll_bottom_margin;
+    if (y < tterm->term->context.scroll_top_margin || y >= bottom || bottom > VD_ROWS || count == 0)
+        return;
+
+    if (count > bottom - y)
+        count = bottom - y;
+
+    size_t start = y * VD_COLS;
+    size_t end = bottom * VD_COLS;
+
+    for (size_t i = end - 1; i >= start + count * VD_COLS; i--)
+        tterm->back_buffer[i] = tterm->back_buffer[i - count * VD_COLS];
+
+    for (size_t i = start; i < start + count * VD_COLS; i += 2)
+    {
+        tterm->back_buffer[i] = ' ';
+        tterm->back_buffer[i + 1] = tterm->context.text_palette;
+    }
+}
+
+void tterm_delete_lines(struct tterm_t *tterm, size_t y, size_t count)
+{
+    size_t bottom = tterm->term->context.scroll_bottom_margin;
+    if (y < tterm->term->context.scroll_top_margin || y >= bottom || bottom > VD_ROWS || count == 0)
+        return;
+
+    if (count > bottom - y)
+        count = bottom - y;
+
+    size_t start = y * VD_COLS;
+    size_t end = bottom * VD_COLS;
+
+    for (size_t i = start; i < end - count * VD_COLS; i++)
+        tterm->back_buffer[i] = tterm->back_buffer[i + count * VD_COLS];
+
+    for (size_t i = end - count * VD_COLS; i < end; i += 2)
+    {
+        tterm->back_buffer[i] = ' ';
+        tterm->back_buffer[i + 1] = tterm->context.text_palette;
+    }
+}
+
 void tterm_scroll(struct tterm_t *tterm)
 {
     for (size_t i = tterm->term->context.scroll_top_margin * VD_COLS; i < (tterm->term->context.scroll_bottom_margin - 1) * VD_COLS; i++)
@@ -269,6 +369,36 @@ void tterm_context_restore(struct tterm_t *tterm, uint64_t ptr)
     }
 }
 
+// The flush compares the back buffer against the front one, so swapping the back buffer
+// for the other screen is enough to draw only the cells that differ
+bool tterm_swap_screen(struct tterm_t *tterm)
+{
+    if (tterm->alt_buffer == NULL)
+    {
+        tterm->alt_buffer = alloc_mem(VD_ROWS * VD_COLS);
+        if (tterm->alt_buffer == NULL)
+            return false;
+
+        for (size_t i = 0; i < VIDEO_BOTTOM; i += 2)
+        {
+            tterm->alt_buffer[i] = ' ';
+            tterm->alt_buffer[i + 1] = 0x07;
+        }
+    }
+
+    uint8_t *tmp = tterm->back_buffer;
+    tterm->back_buffer = tterm->alt_buffer;
+    tterm->alt_buffer = tmp;
+    return true;
+}
+
+// Takes the back buffer as shown without touching video memory, a full refresh then
+// draws it
+void tterm_logical_flush(struct tterm_t *tterm)
+{
+    memcpy(tterm->front_buffer, tterm->back_buffer, VD_ROWS * VD_COLS);
+}
+
 void tterm_full_refresh(struct tterm_t *tterm)
 {
     for (size_t i = 0; i < VD_ROWS * VD_COLS; i++)
@@ -284,4 +414,416 @@ void tterm_full_refresh(struct tterm_t *tterm)
     }
 }
 
+static void panic_newline(struct tterm_t *tterm)
+{
+    tterm->panic_offset += VD_COLS - tterm->panic_offset % VD_COLS;
+    if (tterm->panic_offset < VD_ROWS * VD_COLS)
+        return;
+
+    tterm->panic_offset = (VD_ROWS - 1) * VD_COLS;
+    for (size_t i = 0; i < (VD_ROWS - 1) * VD_COLS; i++)
+        tterm->video_mem[i] = tterm->video_mem[i + VD_COLS];
+    for (size_t i = (VD_ROWS - 1) * VD_COLS; i < VD_ROWS * VD_COLS; i += 2)
+    {
+        tterm->video_mem[i] = ' ';
+        tterm->video_mem[i + 1] = 0x07;
+    }
+}
+
+// Writes straight to video memory, the back buffer may be mid-update on another CPU
+void tterm_panic(struct tterm_t *tterm)
+{
+    size_t offset = tterm->context.cursor_offset;
+    if (offset >= VD_ROWS * VD_COLS)
+        offset = (VD_ROWS - 1) * VD_COLS;
+
+    tterm->panic_offset = offset - offset % VD_COLS;
+    panic_newline(tterm);
+}
+
+void tterm_panic_write(struct tterm_t *tterm, const char *buf, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        uint8_t c = buf[i];
+        switch (c)
+        {
+            case '\n':
+                panic_newline(tterm);
+                continue;
+            case '\r':
+                tterm->panic_offset -= tterm->panic_offset % VD_COLS;
+                continue;
+            case '\t':
+                c = ' ';
+                break;
+        }
+
+        tterm->video_mem[tterm->panic_offset] = c;
+        tterm->video_mem[tterm->panic_offset + 1] = 0x07;
+        tterm->panic_offset += 2;
+        if (tterm->panic_offset % VD_COLS == 0)
+        {
+            tterm->panic_offset -= 2;
+            panic_newline(tterm);
+        }
+    }
+}
+
+// Colours are reported as the VGA attribute nibbles
+void tterm_snapshot(struct tterm_t *tterm, struct term_snapshot *snap)
+{
+    for (size_t i = 0; i < VD_ROWS * VD_COLS / 2; i++)
+    {
+        uint8_t attr = tterm->back_buffer[i * 2 + 1];
+        snap->cells[i].c = tterm->back_buffer[i * 2];
+        snap->cells[i].fg = attr & 0x0F;
+        snap->cells[i].bg = attr >> 4;
+    }
+
+    size_t offset = tterm->context.cursor_offset;
+    snap->cursor_x = (offset % VD_COLS) / 2;
+    snap->cursor_y = offset / VD_COLS;
+    snap->cursor_visible = tterm->context.cursor_status;
+}
+
+void tterm_draw_cell(struct tterm_t *tterm, size_t x, size_t y, const struct term_cell *c)
+{
+    size_t offset = y * VD_COLS + x * 2;
+    if (offset >= VD_ROWS * VD_COLS)
+        return;
+
+    tterm->video_mem[offset] = c->c;
+    tterm->video_mem[offset + 1] = (c->fg & 0x0F) | ((c->bg & 0x0F) << 4);
+}
+
+static void ops_deinit(void *tterm)
+{
+    (void)tterm;
+}
+
+static void ops_putchar(void *tterm, uint8_t c)
+{
+    tterm_putchar(tterm, c);
+}
+
+static void ops_repeat_char(void *tterm, uint8_t c, size_t count)
+{
+    tterm_repeat_char(tterm, c, count);
+}
+
+static void ops_clear(void *tterm, bool move)
+{
+    tterm_clear(tterm, move);
+}
+
+static void ops_enable_cursor(void *tterm)
+{
+    tterm_enable_cursor(tterm);
+}
+
+static bool ops_disable_cursor(void *tterm)
+{
+    return tterm_disable_cursor(tterm);
+}
+
+static void ops_set_cursor_pos(void *tterm, size_t x, size_t y)
+{
+    tterm_set_cursor_pos(tterm, x, y);
+}
+
+static void ops_get_cursor_pos(void *tterm, size_t *x, size_t *y)
+{
+    tterm_get_cursor_pos(tterm, x, y);
+}
+
+static void ops_set_text_fg(void *tterm, size_t fg)
+{
+    tterm_set_text_fg(tterm, fg);
+}
+
+static void ops_set_text_bg(void *tterm, size_t bg)
+{
+    tterm_set_text_bg(tterm, bg);
+}
+
+static void ops_set_text_fg_bright(void *tterm, size_t fg)
+{
+    tterm_set_text_fg_bright(tterm, fg);
+}
+
+static void ops_set_text_bg_bright(void *tterm, size_t bg)
+{
+    tterm_set_text_bg_bright(tterm, bg);
+}
+
+static void ops_set_text_fg_rgb(void *tterm, uint32_t fg)
+{
+    (void)tterm;
+    (void)fg;
+}
+
+static void ops_set_text_bg_rgb(void *tterm, uint32_t bg)
+{
+    (void)tterm;
+    (void)bg;
+}
+
+// The attribute byte has no room for text attributes
+static void ops_set_text_attributes(void *tterm, uint32_t attributes)
+{
+    (void)tterm; (void)attributes;
+}
+
+static void ops_set_text_fg_default(void *tterm)
+{
+    tterm_set_text_fg_default(tterm);
+}
+
+static void ops_set_text_bg_default(void *tterm)
+{
+    tterm_set_text_bg_default(tterm);
+}
+
+static bool ops_scroll_disable(void *tterm)
+{
+    return tterm_scroll_disable(tterm);
+}
+
+static void ops_scroll_enable(void *tterm)
+{
+    tterm_scroll_enable(tterm);
+}
+
+static void ops_move_character(void *tterm, size_t new_x, size_t new_y, size_t old_x, size_t old_y)
+{
+    tterm_move_character(tterm, new_x, new_y, old_x, old_y);
+}
+
+static void ops_insert_chars(void *tterm, size_t x, size_t y, size_t count)
+{
+    tterm_insert_chars(tterm, x, y, count);
+}
+
+static void ops_delete_chars(void *tterm, size_t x, size_t y, size_t count)
+{
+    tterm_delete_chars(tterm, x, y, count);
+}
+
+static void ops_insert_lines(void *tterm, size_t y, size_t count)
+{
+    tterm_insert_lines(tterm, y, count);
+}
+
+static void ops_delete_lines(void *tterm, size_t y, size_t count)
+{
+    tterm_delete_lines(tterm, y, count);
+}
+
+static void ops_scroll(void *tterm)
+{
+    tterm_scroll(tterm);
+}
+
+static void ops_revscroll(void *tterm)
+{
+    tterm_revscroll(tterm);
+}
+
+static void ops_swap_palette(void *tterm)
+{
+    tterm_swap_palette(tterm);
+}
+
+static void ops_save_state(void *tterm)
+{
+    tterm_save_state(tterm);
+}
+
+static void ops_restore_state(void *tterm)
+{
+    tterm_restore_state(tterm);
+}
+
+static void ops_double_buffer_flush(void *tterm)
+{
+    tterm_double_buffer_flush(tterm);
+}
+
+// A text mode frame is only a few kilobytes, it is always flushed in one go
+static bool ops_flush_budget(void *tterm, size_t max_cells, uint64_t max_time)
+{
+    (void)max_cells; (void)max_time;
+    tterm_double_buffer_flush(tterm);
+    return true;
+}
+
+static uint64_t ops_context_size(void *tterm)
+{
+    return tterm_context_size(tterm);
+}
+
+static void ops_context_save(void *tterm, uint64_t ptr)
+{
+    tterm_context_save(tterm, ptr);
+}
+
+static void ops_context_restore(void *tterm, uint64_t ptr)
+{
+    tterm_context_restore(tterm, ptr);
+}
+
+static void ops_full_refresh(void *tterm)
+{
+    tterm_full_refresh(tterm);
+}
+
+static void ops_panic(void *tterm)
+{
+    tterm_panic(tterm);
+}
+
+static void ops_panic_write(void *tterm, const char *buf, size_t count)
+{
+    tterm_panic_write(tterm, buf, count);
+}
+
+static void ops_snapshot(void *tterm, struct term_snapshot *snap)
+{
+    tterm_snapshot(tterm, snap);
+}
+
+static void ops_logical_flush(void *tterm)
+{
+    tterm_logical_flush(tterm);
+}
+
+static void ops_draw_cell(void *tterm, size_t x, size_t y, const struct term_cell *c)
+{
+    tterm_draw_cell(tterm, x, y, c);
+}
+
+// Cells cover the whole text mode screen
+static void ops_draw_background(void *tterm)
+{
+    (void)tterm;
+}
+
+// Text mode only has the 16 colours of the attribute byte
+static void ops_set_text_fg_indexed(void *tterm, size_t fg)
+{
+    if (fg < 8)
+        tterm_set_text_fg(tterm, fg);
+    else if (fg < 16)
+        tterm_set_text_fg_bright(tterm, fg - 8);
+}
+
+static void ops_set_text_bg_indexed(void *tterm, size_t bg)
+{
+    if (bg < 8)
+        tterm_set_text_bg(tterm, bg);
+    else if (bg < 16)
+        tterm_set_text_bg_bright(tterm, bg - 8);
+}
+
+static void ops_set_palette(void *tterm, size_t index, uint32_t rgb)
+{
+    (void)tterm; (void)index; (void)rgb;
+}
+
+static void ops_reset_palette(void *tterm)
+{
+    (void)tterm;
+}
+
+// Text mode only has the code page 437 glyphs of the VGA font
+static bool ops_put_code_point(void *tterm, uint32_t code_point)
+{
+    (void)tterm; (void)code_point;
+    return false;
+}
+
+// The text mode cursor is always a steady block of inverted colours
+static void ops_set_cursor_shape(void *tterm, size_t shape, bool blink)
+{
+    (void)tterm; (void)shape; (void)blink;
+}
+
+static bool ops_cursor_tick(void *tterm)
+{
+    (void)tterm;
+    return false;
+}
+
+static bool ops_swap_screen(void *tterm)
+{
+    return tterm_swap_screen(tterm);
+}
+
+// Text mode keeps no history
+static bool ops_set_scrollback(void *tterm, size_t lines)
+{
+    (void)tterm;
+    return lines == 0;
+}
+
+static void ops_scroll_viewport(void *tterm, int64_t lines)
+{
+    (void)tterm; (void)lines;
+}
+
+const struct term_backend_ops tterm_backend_ops = {
+    .deinit = ops_deinit,
+    .putchar = ops_putchar,
+    .repeat_char = ops_repeat_char,
+    .clear = ops_clear,
+    .enable_cursor = ops_enable_cursor,
+    .disable_cursor = ops_disable_cursor,
+    .set_cursor_pos = ops_set_cursor_pos,
+    .get_cursor_pos = ops_get_cursor_pos,
+    .set_text_fg = ops_set_text_fg,
+    .set_text_bg = ops_set_text_bg,
+    .set_text_fg_bright = ops_set_text_fg_bright,
+    .set_text_bg_bright = ops_set_text_bg_bright,
+    .set_text_fg_rgb = ops_set_text_fg_rgb,
+    .set_text_bg_rgb = ops_set_text_bg_rgb,
+    .set_text_fg_default = ops_set_text_fg_default,
+    .set_text_bg_default = ops_set_text_bg_default,
+    .set_text_attributes = ops_set_text_attributes,
+    .scroll_disable = ops_scroll_disable,
+    .scroll_enable = ops_scroll_enable,
+    .move_character = ops_move_character,
+    .insert_chars = ops_insert_chars,
+    .delete_chars = ops_delete_chars,
+    .insert_lines = ops_insert_lines,
+    .delete_lines = ops_delete_lines,
+    .scroll = ops_scroll,
+    .revscroll = ops_revscroll,
+    .swap_palette = ops_swap_palette,
+    .save_state = ops_save_state,
+    .restore_state = ops_restore_state,
+    .double_buffer_flush = ops_double_buffer_flush,
+    .flush_budget = ops_flush_budget,
+    .context_size = ops_context_size,
+    .context_save = ops_context_save,
+    .context_restore = ops_context_restore,
+    .full_refresh = ops_full_refresh,
+    .panic = ops_panic,
+    .panic_write = ops_panic_write,
+    .snapshot = ops_snapshot,
+    .logical_flush = ops_logical_flush,
+    .draw_cell = ops_draw_cell,
+    .draw_background = ops_draw_background,
+    .set_scrollback = ops_set_scrollback,
+    .scroll_viewport = ops_scroll_viewport,
+    .swap_screen = ops_swap_screen,
+    .set_text_fg_indexed = ops_set_text_fg_indexed,
+    .set_text_bg_indexed = ops_set_text_bg_indexed,
+    .set_palette = ops_set_palette,
+    .reset_palette = ops_reset_palette,
+    .put_code_point = ops_put_code_point,
+    .set_cursor_shape = ops_set_cursor_shape,
+    .cursor_tick = ops_cursor_tick
+};
+
 #endif
\ No newline at end of file
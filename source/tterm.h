@@ -29,8 +29,10 @@ struct tterm_t
     volatile uint8_t *video_mem;
     uint8_t *back_buffer;
     uint8_t *front_buffer;
+    uint8_t *alt_buffer;
 
     size_t old_cursor_offset;
+    size_t panic_offset;
 
     struct tterm_context context;
     struct term_t *term;
@@ -38,6 +40,7 @@ struct tterm_t
 
 void tterm_init(struct tterm_t *tterm, struct term_t *term);
 void tterm_putchar(struct tterm_t *tterm, uint8_t c);
+void tterm_repeat_char(struct tterm_t *tterm, uint8_t c, size_t count);
 void tterm_clear(struct tterm_t *tterm, bool move);
 void tterm_enable_cursor(struct tterm_t *tterm);
 bool tterm_disable_cursor(struct tterm_t *tterm);
@@ -52,6 +55,10 @@ void tterm_set_text_bg_default(struct tterm_t *tterm);
 bool tterm_scroll_disable(struct tterm_t *tterm);
 void tterm_scroll_enable(struct tterm_t *tterm);
 void tterm_move_character(struct tterm_t *tterm, size_t new_x, size_t new_y, size_t old_x, size_t old_y);
+void tterm_insert_chars(struct tterm_t *tterm, size_t x, size_t y, size_t count);
+void tterm_delete_chars(struct tterm_t *tterm, size_t x, size_t y, size_t count);
+void tterm_insert_lines(struct tterm_t *tterm, size_t y, size_t count);
+void tterm_delete_lines(struct tterm_t *tterm, size_t y, size_t count);
 void tterm_scroll(struct tterm_t *tterm);
 void tterm_revscroll(struct tterm_t *tterm);
 void tterm_swap_palette(struct tterm_t *tterm);
@@ -61,7 +68,15 @@ void tterm_double_buffer_flush(struct tterm_t *tterm);
 uint64_t tterm_context_size(struct tterm_t *tterm);
 void tterm_context_save(struct tterm_t *tterm, uint64_t ptr);
 void tterm_context_restore(struct tterm_t *tterm, uint64_t ptr);
+bool tterm_swap_screen(struct tterm_t *tterm);
+void tterm_logical_flush(struct tterm_t *tterm);
 void tterm_full_refresh(struct tterm_t *tterm);
+void tterm_panic(struct tterm_t *tterm);
+void tterm_panic_write(struct tterm_t *tterm, const char *buf, size_t count);
+void tterm_snapshot(struct tterm_t *tterm, struct term_snapshot *snap);
+void tterm_draw_cell(struct tterm_t *tterm, size_t x, size_t y, const struct term_cell *c);
+
+extern const struct term_backend_ops tterm_backend_ops;
 
 #ifdef __cplusplus
 }
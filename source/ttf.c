@@ -0,0 +1,747 @@
+#include "ttf.h"
+#include "term.h"
+
+#define TTF_SUBROWS 16
+#define TTF_MAX_DEPTH 8
+
+#define TTF_ON_CURVE 0x01
+#define TTF_X_SHORT 0x02
+#define TTF_Y_SHORT 0x04
+#define TTF_REPEAT 0x08
+#define TTF_X_SAME 0x10
+#define TTF_Y_SAME 0x20
+
+#define TTF_ARGS_ARE_WORDS 0x0001
+#define TTF_ARGS_ARE_XY 0x0002
+#define TTF_HAVE_SCALE 0x0008
+#define TTF_MORE_COMPONENTS 0x0020
+#define TTF_HAVE_XY_SCALE 0x0040
+#define TTF_HAVE_2X2 0x0080
+
+struct ttf_point
+{
+    int32_t x, y;
+};
+
+struct ttf_edge
+{
+    int32_t x0, y0, x1, y1;
+};
+
+// Component transforms, 2.14 fixed point matrix and offsets in font units
+struct ttf_transform
+{
+    int32_t a, b, c, d;
+    int32_t e, f;
+};
+
+struct ttf_outline
+{
+    struct ttf_renderer *ttf;
+    int32_t offset_x;
+    struct ttf_edge *edges;
+    size_t count;
+    size_t capacity;
+};
+
+struct ttf_crossing
+{
+    int32_t x;
+    int32_t dir;
+};
+
+static uint16_t read16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t read32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static bool find_table(const uint8_t *data, size_t size, uint32_t tag, size_t *offset, size_t *length)
+{
+    if (size < 12)
+        return false;
+
+    size_t tables = read16(data + 4);
+    if (12 + tables * 16 > size)
+        return false;
+
+    for (size_t i = 0; i < tables; i++)
+    {
+        const uint8_t *record = data + 12 + i * 16;
+        if (read32(record) != tag)
+            continue;
+
+        *offset = read32(record + 8);
+        *length = read32(record + 12);
+        return *offset <= size && *length <= size - *offset;
+    }
+
+    return false;
+}
+
+static bool add_edge(struct ttf_outline *o, struct ttf_point p0, struct ttf_point p1)
+{
+    if (p0.y == p1.y)
+        return true;
+
+    if (o->count == o->capacity)
+    {
+        size_t capacity = o->capacity ? o->capacity * 2 : 64;
+        struct ttf_edge *edges = alloc_mem(capacity * sizeof(struct ttf_edge));
+        if (edges == NULL)
+            return false;
+
+        if (o->edges != NULL)
+        {
+            memcpy(edges, o->edges, o->count * sizeof(struct ttf_edge));
+            free_mem(o->edges, o->capacity * sizeof(struct ttf_edge));
+        }
+        o->edges = edges;
+        o->capacity = capacity;
+    }
+
+    struct ttf_edge *edge = &o->edges[o->count++];
+    edge->x0 = p0.x;
+    edge->y0 = p0.y;
+    edge->x1 = p1.x;
+    edge->y1 = p1.y;
+    return true;
+}
+
+static int64_t abs64(int64_t a)
+{
+    return a < 0 ? -a : a;
+}
+
+// Quadratic curves are split into enough lines to stay within about an eighth of a pixel
+static bool add_curve(struct ttf_outline *o, struct ttf_point p0, struct ttf_point p1, struct ttf_point p2)
+{
+    int64_t deviation = abs64((int64_t)p0.x - 2 * p1.x + p2.x) + abs64((int64_t)p0.y - 2 * p1.y + p2.y);
+    int64_t n = 1;
+    while (n < 16 && n * n * 256 < deviation)
+        n++;
+
+    struct ttf_point from = p0;
+    for (int64_t i = 1; i <= n; i++)
+    {
+        int64_t j = n - i;
+        struct ttf_point to = {
+            (int32_t)((j * j * p0.x + 2 * i * j * p1.x + i * i * p2.x) / (n * n)),
+            (int32_t)((j * j * p0.y + 2 * i * j * p1.y + i * i * p2.y) / (n * n))
+        };
+        if (!add_edge(o, from, to))
+            return false;
+        from = to;
+    }
+
+    return true;
+}
+
+static struct ttf_point midpoint(struct ttf_point a, struct ttf_point b)
+{
+    struct ttf_point m = { (a.x + b.x) / 2, (a.y + b.y) / 2 };
+    return m;
+}
+
+// Contours may start and end with off-curve points, and two off-curve points in a row have an
+// implied on-curve point halfway between them
+static bool add_contour(struct ttf_outline *o, const struct ttf_point *points, const uint8_t *flags, size_t first, size_t last)
+{
+    struct ttf_point start;
+    size_t from = first, to = last;
+    if (flags[first] & TTF_ON_CURVE)
+        start = points[from++];
+    else if (flags[last] & TTF_ON_CURVE)
+        start = points[to--];
+    else
+        start = midpoint(points[first], points[last]);
+
+    struct ttf_point current = start, control = start;
+    bool pending = false;
+
+    for (size_t i = from; i <= to && i <= last; i++)
+    {
+        bool ok;
+        if (flags[i] & TTF_ON_CURVE)
+        {
+            ok = pending ? add_curve(o, current, control, points[i]) : add_edge(o, current, points[i]);
+            current = points[i];
+            pending = false;
+        }
+        else if (pending)
+        {
+            struct ttf_point m = midpoint(control, points[i]);
+            ok = add_curve(o, current, control, m);
+            current = m;
+            control = points[i];
+        }
+        else
+        {
+            ok = true;
+            control = points[i];
+            pending = true;
+        }
+
+        if (!ok)
+            return false;
+    }
+
+    return pending ? add_curve(o, current, control, start) : add_edge(o, current, start);
+}
+
+static struct ttf_point to_pixels(struct ttf_outline *o, const struct ttf_transform *t, int32_t x, int32_t y)
+{
+    int64_t fx = (((int64_t)t->a * x + (int64_t)t->c * y) >> 14) + t->e;
+    int64_t fy = (((int64_t)t->b * x + (int64_t)t->d * y) >> 14) + t->f;
+
+    struct ttf_point p = {
+        (int32_t)((fx * o->ttf->scale) >> 8) + o->offset_x,
+        o->ttf->baseline - (int32_t)((fy * o->ttf->scale) >> 8)
+    };
+    return p;
+}
+
+static bool simple_glyph(struct ttf_outline *o, const uint8_t *glyph, size_t length, size_t contours, const struct ttf_transform *t)
+{
+    size_t pos = 10;
+    if (pos + contours * 2 + 2 > length)
+        return false;
+
+    size_t points = (size_t)read16(glyph + pos + (contours - 1) * 2) + 1;
+    const uint8_t *ends = glyph + pos;
+    pos += contours * 2;
+    pos += 2 + read16(glyph + pos);
+
+    size_t scratch_size = points * (sizeof(struct ttf_point) + 1);
+    struct ttf_point *coords = alloc_mem(scratch_size);
+    if (coords == NULL)
+        return false;
+    uint8_t *flags = (uint8_t*)&coords[points];
+
+    bool ok = true;
+    for (size_t i = 0; i < points && ok; )
+    {
+        if (pos >= length)
+        {
+            ok = false;
+            break;
+        }
+        uint8_t flag = glyph[pos++];
+        size_t repeat = 1;
+        if (flag & TTF_REPEAT)
+        {
+            if (pos >= length)
+            {
+                ok = false;
+                break;
+            }
+            repeat += glyph[pos++];
+        }
+        while (repeat-- > 0 && i < points)
+            flags[i++] = flag;
+    }
+
+    // x coordinates, then y coordinates, are deltas from the previous point
+    for (size_t axis = 0; axis < 2 && ok; axis++)
+    {
+        uint8_t is_short = axis == 0 ? TTF_X_SHORT : TTF_Y_SHORT;
+        uint8_t same = axis == 0 ? TTF_X_SAME : TTF_Y_SAME;
+        int32_t value = 0;
+
+        for (size_t i = 0; i < points; i++)
+        {
+            if (flags[i] & is_short)
+            {
+                if (pos + 1 > length)
+                {
+                    ok = false;
+                    break;
+                }
+                value += (flags[i] & same) ? glyph[pos] : -(int32_t)glyph[pos];
+                pos++;
+            }
+            else if (!(flags[i] & same))
+            {
+                if (pos + 2 > length)
+                {
+                    ok = false;
+                    break;
+                }
+                value += (int16_t)read16(glyph + pos);
+                pos += 2;
+            }
+
+            if (axis == 0)
+                coords[i].x = value;
+            else
+                coords[i].y = value;
+        }
+    }
+
+    for (size_t i = 0; i < points && ok; i++)
+        coords[i] = to_pixels(o, t, coords[i].x, coords[i].y);
+
+    size_t first = 0;
+    for (size_t i = 0; i < contours && ok; i++)
+    {
+        size_t last = read16(ends + i * 2);
+        if (last < first || last >= points)
+        {
+            ok = false;
+            break;
+        }
+        ok = add_contour(o, coords, flags, first, last);
+        first = last + 1;
+    }
+
+    free_mem(coords, scratch_size);
+    return ok;
+}
+
+static bool glyph_range(struct ttf_renderer *ttf, uint32_t glyph, size_t *start, size_t *end)
+{
+    const uint8_t *loca = ttf->data + ttf->loca;
+    if (ttf->long_loca)
+    {
+        *start = read32(loca + glyph * 4);
+        *end = read32(loca + glyph * 4 + 4);
+    }
+    else
+    {
+        *start = (size_t)read16(loca + glyph * 2) * 2;
+        *end = (size_t)read16(loca + glyph * 2 + 2) * 2;
+    }
+
+    return *start <= *end && *end <= ttf->glyf_size;
+}
+
+static bool load_glyph(struct ttf_outline *o, uint32_t glyph, const struct ttf_transform *t, size_t depth)
+{
+    struct ttf_renderer *ttf = o->ttf;
+    size_t start, end;
+    if (glyph >= ttf->glyphs || depth > TTF_MAX_DEPTH || !glyph_range(ttf, glyph, &start, &end))
+        return false;
+
+    // Glyphs without an outline, like the space
+    if (start == end)
+        return true;
+    if (end - start < 10)
+        return false;
+
+    const uint8_t *data = ttf->data + ttf->glyf + start;
+    size_t length = end - start;
+    int16_t contours = (int16_t)read16(data);
+    if (contours >= 0)
+        return contours == 0 || simple_glyph(o, data, length, contours, t);
+
+    // Composite glyphs place other glyphs, their offsets are taken as x and y values rather
+    // than matching points
+    size_t pos = 10;
+    uint16_t flags;
+    do
+    {
+        if (pos + 4 > length)
+            return false;
+        flags = read16(data + pos);
+        uint32_t component = read16(data + pos + 2);
+        pos += 4;
+
+        int32_t dx, dy;
+        if (flags & TTF_ARGS_ARE_WORDS)
+        {
+            if (pos + 4 > length)
+                return false;
+            dx = (int16_t)read16(data + pos);
+            dy = (int16_t)read16(data + pos + 2);
+            pos += 4;
+        }
+        else
+        {
+            if (pos + 2 > length)
+                return false;
+            dx = (int8_t)data[pos];
+            dy = (int8_t)data[pos + 1];
+            pos += 2;
+        }
+        if (!(flags & TTF_ARGS_ARE_XY))
+            dx = dy = 0;
+
+        struct ttf_transform local = { 16384, 0, 0, 16384, dx, dy };
+        size_t scales = (flags & TTF_HAVE_SCALE) ? 1 : (flags & TTF_HAVE_XY_SCALE) ? 2 : (flags & TTF_HAVE_2X2) ? 4 : 0;
+        if (pos + scales * 2 > length)
+            return false;
+        if (scales == 1)
+            local.a = local.d = (int16_t)read16(data + pos);
+        else if (scales == 2)
+        {
+            local.a = (int16_t)read16(data + pos);
+            local.d = (int16_t)read16(data + pos + 2);
+        }
+        else if (scales == 4)
+        {
+            local.a = (int16_t)read16(data + pos);
+            local.b = (int16_t)read16(data + pos + 2);
+            local.c = (int16_t)read16(data + pos + 4);
+            local.d = (int16_t)read16(data + pos + 6);
+        }
+        pos += scales * 2;
+
+        struct ttf_transform combined = {
+            (int32_t)(((int64_t)t->a * local.a + (int64_t)t->c * local.b) >> 14),
+            (int32_t)(((int64_t)t->b * local.a + (int64_t)t->d * local.b) >> 14),
+            (int32_t)(((int64_t)t->a * local.c + (int64_t)t->c * local.d) >> 14),
+            (int32_t)(((int64_t)t->b * local.c + (int64_t)t->d * local.d) >> 14),
+            (int32_t)((((int64_t)t->a * dx + (int64_t)t->c * dy) >> 14) + t->e),
+            (int32_t)((((int64_t)t->b * dx + (int64_t)t->d * dy) >> 14) + t->f)
+        };
+
+        if (!load_glyph(o, component, &combined, depth + 1))
+            return false;
+    } while (flags & TTF_MORE_COMPONENTS);
+
+    return true;
+}
+
+static void add_span(uint32_t *row, int32_t from, int32_t to, size_t width)
+{
+    if (from < 0)
+        from = 0;
+    if (to > (int32_t)width * 256)
+        to = (int32_t)width * 256;
+    if (from >= to)
+        return;
+
+    int32_t first = from >> 8, last = (to - 1) >> 8;
+    if (first == last)
+    {
+        row[first] += to - from;
+        return;
+    }
+
+    row[first] += 256 - (from & 0xFF);
+    for (int32_t x = first + 1; x < last; x++)
+        row[x] += 256;
+    row[last] += to - last * 256;
+}
+
+// Each pixel row is sampled on TTF_SUBROWS lines, summing the exact width covered on each
+// line under the non-zero winding rule
+static bool fill_outline(struct ttf_outline *o, uint8_t *coverage, size_t stride)
+{
+    size_t width = o->ttf->width, height = o->ttf->height;
+    size_t scratch_size = o->count * sizeof(struct ttf_crossing) + width * sizeof(uint32_t);
+    struct ttf_crossing *crossings = alloc_mem(scratch_size);
+    if (crossings == NULL)
+        return false;
+    uint32_t *row = (uint32_t*)&crossings[o->count];
+
+    for (size_t y = 0; y < height; y++)
+    {
+        memset(row, 0, width * sizeof(uint32_t));
+
+        for (size_t sub = 0; sub < TTF_SUBROWS; sub++)
+        {
+            int32_t sy = (int32_t)(y * 256 + (sub * 256 + 128) / TTF_SUBROWS);
+            size_t n = 0;
+
+            for (size_t i = 0; i < o->count; i++)
+            {
+                struct ttf_edge *e = &o->edges[i];
+                int32_t dir;
+                if (e->y0 <= sy && sy < e->y1)
+                    dir = 1;
+                else if (e->y1 <= sy && sy < e->y0)
+                    dir = -1;
+                else
+                    continue;
+
+                int32_t x = e->x0 + (int32_t)((int64_t)(sy - e->y0) * (e->x1 - e->x0) / (e->y1 - e->y0));
+                size_t j = n++;
+                while (j > 0 && crossings[j - 1].x > x)
+                {
+                    crossings[j] = crossings[j - 1];
+                    j--;
+                }
+                crossings[j].x = x;
+                crossings[j].dir = dir;
+            }
+
+            int32_t winding = 0;
+            for (size_t i = 0; i + 1 < n; i++)
+            {
+                winding += crossings[i].dir;
+                if (winding != 0)
+                    add_span(row, crossings[i].x, crossings[i + 1].x, width);
+            }
+        }
+
+        for (size_t x = 0; x < width; x++)
+        {
+            uint32_t value = (row[x] * 255 + 128 * TTF_SUBROWS) / (256 * TTF_SUBROWS);
+            coverage[y * stride + x] = value > 255 ? 255 : value;
+        }
+    }
+
+    free_mem(crossings, scratch_size);
+    return true;
+}
+
+static uint16_t advance_width(struct ttf_renderer *ttf, uint32_t glyph)
+{
+    uint32_t metric = glyph < ttf->hmetrics ? glyph : ttf->hmetrics - 1u;
+    return read16(ttf->data + ttf->hmtx + metric * 4);
+}
+
+// Called by terminals the first time they need a glyph. Glyphs narrower than the cell are
+// centred in it.
+static bool ttf_render(void *renderer, uint32_t glyph, uint8_t *coverage, size_t stride)
+{
+    struct ttf_renderer *ttf = renderer;
+
+    for (size_t y = 0; y < ttf->height; y++)
+        memset(&coverage[y * stride], 0, ttf->width);
+
+    int32_t advance = (int32_t)(((int64_t)advance_width(ttf, glyph) * ttf->scale) >> 8);
+    struct ttf_outline o = { ttf, 0, NULL, 0, 0 };
+    if (advance < ttf->width * 256)
+        o.offset_x = (ttf->width * 256 - advance) / 2;
+
+    struct ttf_transform identity = { 16384, 0, 0, 16384, 0, 0 };
+    bool ok = load_glyph(&o, glyph, &identity, 0);
+    if (ok && o.count != 0)
+        ok = fill_outline(&o, coverage, stride);
+
+    if (o.edges != NULL)
+        free_mem(o.edges, o.capacity * sizeof(struct ttf_edge));
+    return ok;
+}
+
+// Format 4 maps 16 bit code points in segments, format 12 maps groups of any code points.
+// Entries have to be in order, anything going backwards is dropped. Counts the entries if
+// map is NULL.
+static size_t cmap_entries(const uint8_t *table, size_t length, uint32_t glyphs, struct font_map_t *map)
+{
+    size_t count = 0;
+    uint32_t next = 0;
+    uint16_t format = read16(table);
+
+    if (format == 4)
+    {
+        size_t segments = read16(table + 6) / 2;
+        if (16 + segments * 8 > length)
+            return 0;
+
+        const uint8_t *ends = table + 14, *starts = ends + segments * 2 + 2;
+        const uint8_t *deltas = starts + segments * 2, *ranges = deltas + segments * 2;
+
+        for (size_t i = 0; i < segments; i++)
+        {
+            uint32_t start = read16(starts + i * 2), end = read16(ends + i * 2);
+            uint16_t delta = read16(deltas + i * 2), range = read16(ranges + i * 2);
+
+            for (uint32_t c = start < next ? next : start; c <= end && c != 0xFFFF; c++)
+            {
+                uint32_t glyph;
+                if (range == 0)
+                    glyph = (c + delta) & 0xFFFF;
+                else
+                {
+                    size_t offset = (size_t)(ranges + i * 2 - table) + range + (c - start) * 2;
+                    if (offset + 2 > length)
+                        break;
+                    glyph = read16(table + offset);
+                    if (glyph != 0)
+                        glyph = (glyph + delta) & 0xFFFF;
+                }
+
+                next = c + 1;
+                if (glyph == 0 || glyph >= glyphs)
+                    continue;
+                if (map != NULL)
+                {
+                    map[count].code_point = c;
+                    map[count].glyph = glyph;
+                }
+                count++;
+            }
+        }
+    }
+    else if (format == 12)
+    {
+        if (length < 16)
+            return 0;
+        size_t groups = read32(table + 12);
+        if (groups > (length - 16) / 12)
+            return 0;
+
+        for (size_t i = 0; i < groups; i++)
+        {
+            const uint8_t *group = table + 16 + i * 12;
+            uint32_t start = read32(group), end = read32(group + 4), first = read32(group + 8);
+            if (end > 0x10FFFF)
+                end = 0x10FFFF;
+
+            for (uint32_t c = start < next ? next : start; c <= end; c++)
+            {
+                uint32_t glyph = first + (c - start);
+                next = c + 1;
+                if (glyph == 0 || glyph >= glyphs)
+                    continue;
+                if (map != NULL)
+                {
+                    map[count].code_point = c;
+                    map[count].glyph = glyph;
+                }
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+// Prefers the full Unicode table, then the Basic Multilingual Plane one
+static bool open_cmap(struct font_t *font, const uint8_t *cmap, size_t length, uint32_t glyphs)
+{
+    if (length < 4)
+        return false;
+
+    const uint8_t *best = NULL;
+    size_t best_length = 0;
+    int best_rank = 0;
+
+    size_t tables = read16(cmap + 2);
+    for (size_t i = 0; i < tables && 4 + i * 8 + 8 <= length; i++)
+    {
+        const uint8_t *record = cmap + 4 + i * 8;
+        uint16_t platform = read16(record), encoding = read16(record + 2);
+        size_t offset = read32(record + 4);
+        if (offset + 8 > length)
+            continue;
+
+        const uint8_t *table = cmap + offset;
+        uint16_t format = read16(table);
+        size_t table_length = format == 12 ? read32(table + 4) : read16(table + 2);
+        if (table_length > length - offset)
+            table_length = length - offset;
+
+        bool unicode = platform == 0 || (platform == 3 && (encoding == 1 || encoding == 10));
+        int rank = !unicode ? 0 : format == 12 ? 2 : format == 4 ? 1 : 0;
+        if (rank > best_rank)
+        {
+            best = table;
+            best_length = table_length;
+            best_rank = rank;
+        }
+    }
+
+    if (best == NULL)
+        return false;
+
+    size_t count = cmap_entries(best, best_length, glyphs, NULL);
+    if (count == 0)
+        return false;
+
+    struct font_map_t *map = alloc_mem(count * sizeof(struct font_map_t));
+    if (map == NULL)
+        return false;
+    cmap_entries(best, best_length, glyphs, map);
+
+    font->map = map;
+    font->map_size = count;
+    font->allocated_map_size = count * sizeof(struct font_map_t);
+    return true;
+}
+
+static bool map_lookup(const struct font_t *font, uint32_t code_point, uint32_t *glyph)
+{
+    size_t lo = 0, hi = font->map_size;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (font->map[mid].code_point == code_point)
+        {
+            *glyph = font->map[mid].glyph;
+            return true;
+        }
+
+        if (font->map[mid].code_point < code_point)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return false;
+}
+
+// Opens a TrueType font drawn into cells height pixels tall, as wide as its 'M'. Glyphs are
+// rasterised when a terminal first uses them, spacing and scaling are left at 0.
+bool ttf_open_font(struct font_t *font, uint64_t file, uint64_t size, uint8_t height)
+{
+    const uint8_t *data = (const uint8_t*)file;
+    size_t head, head_length, maxp, maxp_length, hhea, hhea_length, hmtx, hmtx_length;
+    size_t loca, loca_length, glyf, glyf_length, cmap, cmap_length;
+
+    if (height == 0
+        || !find_table(data, size, TTF_TAG('h', 'e', 'a', 'd'), &head, &head_length) || head_length < 54
+        || !find_table(data, size, TTF_TAG('m', 'a', 'x', 'p'), &maxp, &maxp_length) || maxp_length < 6
+        || !find_table(data, size, TTF_TAG('h', 'h', 'e', 'a'), &hhea, &hhea_length) || hhea_length < 36
+        || !find_table(data, size, TTF_TAG('h', 'm', 't', 'x'), &hmtx, &hmtx_length)
+        || !find_table(data, size, TTF_TAG('l', 'o', 'c', 'a'), &loca, &loca_length)
+        || !find_table(data, size, TTF_TAG('g', 'l', 'y', 'f'), &glyf, &glyf_length)
+        || !find_table(data, size, TTF_TAG('c', 'm', 'a', 'p'), &cmap, &cmap_length))
+        return false;
+
+    bool long_loca = read16(data + head + 50) != 0;
+    uint32_t glyphs = read16(data + maxp + 4);
+    int32_t ascender = (int16_t)read16(data + hhea + 4);
+    int32_t descender = (int16_t)read16(data + hhea + 6);
+    uint16_t advance_max = read16(data + hhea + 10);
+    uint16_t hmetrics = read16(data + hhea + 34);
+
+    if (glyphs == 0 || hmetrics == 0 || ascender <= descender
+        || hmtx_length < (size_t)hmetrics * 4 || loca_length < (glyphs + 1) * (long_loca ? 4 : 2))
+        return false;
+
+    memset(font, 0, sizeof(struct font_t));
+    if (!open_cmap(font, data + cmap, cmap_length, glyphs))
+        return false;
+
+    struct ttf_renderer *ttf = alloc_mem(sizeof(struct ttf_renderer));
+    if (ttf == NULL)
+    {
+        font_close(font);
+        return false;
+    }
+
+    ttf->data = data;
+    ttf->size = size;
+    ttf->loca = loca;
+    ttf->glyf = glyf;
+    ttf->glyf_size = glyf_length;
+    ttf->hmtx = hmtx;
+    ttf->glyphs = glyphs;
+    ttf->hmetrics = hmetrics;
+    ttf->long_loca = long_loca;
+    ttf->scale = (int32_t)(((int64_t)height << 16) / (ascender - descender));
+    ttf->baseline = (int32_t)(((int64_t)ascender * ttf->scale) >> 8);
+    ttf->height = height;
+
+    uint32_t glyph;
+    uint32_t advance = map_lookup(font, 'M', &glyph) ? advance_width(ttf, glyph) : advance_max;
+    uint32_t width = (uint32_t)(((int64_t)advance * ttf->scale + 32768) >> 16);
+    ttf->width = width == 0 ? 1 : width > 255 ? 255 : width;
+
+    font->width = ttf->width;
+    font->height = height;
+    font->glyphs = glyphs;
+    font->bpp = 8;
+    font->render = ttf_render;
+    font->renderer = ttf;
+    font->allocated_renderer_size = sizeof(struct ttf_renderer);
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef TTF_H
+#define TTF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "font.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TTF_TAG(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+// Table offsets of an open TrueType font, the file has to stay mapped while in use.
+// Coordinates are scaled to pixels in 24.8 fixed point.
+struct ttf_renderer
+{
+    const uint8_t *data;
+    size_t size;
+
+    size_t loca;
+    size_t glyf;
+    size_t glyf_size;
+    size_t hmtx;
+    uint32_t glyphs;
+    uint16_t hmetrics;
+    bool long_loca;
+
+    int32_t scale;
+    int32_t baseline;
+    uint8_t width;
+    uint8_t height;
+};
+
+bool ttf_open_font(struct font_t *font, uint64_t file, uint64_t size, uint8_t height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TTF_H